@@ -0,0 +1,315 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+/*
+ * Measures how fast netlink.c programs the kernel. Runs in a private
+ * network namespace on a dummy interface, needs CAP_SYS_ADMIN and
+ * CAP_NET_ADMIN, e.g.:
+ *
+ * $ sudo ./nlbench 1000 10000 100000
+ *
+ * The sync mode waits for every single ack as rpld did before batching,
+ * the batched mode queues everything and lets netlink.c fill batches.
+ */
+
+#define _GNU_SOURCE
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <libmnl/libmnl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "netlink.h"
+#include "config.h"
+#include "log.h"
+
+#define NLBENCH_IFNAME	"nlbench0"
+/* meson treats this as skipped */
+#define NLBENCH_SKIP	77
+
+enum nlbench_op {
+	NLBENCH_ADD_ROUTE,
+	NLBENCH_DEL_ROUTE,
+	NLBENCH_ADD_ADDR,
+};
+
+static const char *const nlbench_op_str[] = {
+	[NLBENCH_ADD_ROUTE] = "nl_add_route_via",
+	[NLBENCH_DEL_ROUTE] = "nl_del_route_via",
+	[NLBENCH_ADD_ADDR] = "nl_add_addr",
+};
+
+struct nlbench_req {
+	double submit;
+	double done;
+	int err;
+};
+
+static const struct in6_addr via = {
+	.s6_addr = { 0xfe, 0x80, [15] = 0x01 },
+};
+
+static double nlbench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void nlbench_cb(int err, void *data)
+{
+	struct nlbench_req *req = data;
+
+	req->done = nlbench_now();
+	req->err = err;
+}
+
+/* fd00:<prefix>::<i>, a different prefix per run keeps the mirror cold */
+static void nlbench_addr(struct in6_addr *addr, uint16_t prefix, uint32_t i)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->s6_addr[0] = 0xfd;
+	addr->s6_addr[2] = prefix >> 8;
+	addr->s6_addr[3] = prefix & 0xff;
+	addr->s6_addr[12] = i >> 24;
+	addr->s6_addr[13] = i >> 16;
+	addr->s6_addr[14] = i >> 8;
+	addr->s6_addr[15] = i;
+}
+
+static int nlbench_submit(enum nlbench_op op, uint32_t ifindex,
+			  uint16_t prefix, uint32_t i,
+			  struct nlbench_req *req)
+{
+	struct in6_prefix dst;
+
+	nlbench_addr(&dst.prefix, prefix, i);
+	dst.len = 128;
+
+	req->submit = nlbench_now();
+	switch (op) {
+	case NLBENCH_ADD_ROUTE:
+		return nl_add_route_via(ifindex, &dst.prefix, &via,
+					nlbench_cb, req);
+	case NLBENCH_DEL_ROUTE:
+		return nl_del_route_via(ifindex, &dst, (struct in6_addr *)&via,
+					nlbench_cb, req);
+	case NLBENCH_ADD_ADDR:
+		return nl_add_addr(ifindex, &dst.prefix, nlbench_cb, req);
+	}
+
+	return -1;
+}
+
+static int nlbench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double nlbench_pct(const double *lat, uint32_t n, double p)
+{
+	uint32_t i = p * (n - 1);
+
+	return lat[i] * 1e6;
+}
+
+static void nlbench_report(enum nlbench_op op, bool batched, uint32_t n,
+			   struct nlbench_req *reqs, double total)
+{
+	uint32_t i, errs = 0;
+	double *lat;
+
+	lat = calloc(n, sizeof(*lat));
+	if (!lat)
+		return;
+
+	for (i = 0; i < n; i++) {
+		lat[i] = reqs[i].done - reqs[i].submit;
+		if (reqs[i].err)
+			errs++;
+	}
+	qsort(lat, n, sizeof(*lat), nlbench_cmp);
+
+	printf("%-17s %-8s %7u %9.3f %10.0f %9.1f %9.1f %9.1f %9.1f %6u\n",
+	       nlbench_op_str[op], batched ? "batched" : "sync", n, total,
+	       n / total, nlbench_pct(lat, n, 0.5), nlbench_pct(lat, n, 0.9),
+	       nlbench_pct(lat, n, 0.99), lat[n - 1] * 1e6, errs);
+
+	free(lat);
+}
+
+static int nlbench_run(enum nlbench_op op, bool batched, uint32_t ifindex,
+		       uint16_t prefix, uint32_t n)
+{
+	struct nlbench_req *reqs;
+	double start;
+	uint32_t i;
+	int rc = 0;
+
+	reqs = calloc(n, sizeof(*reqs));
+	if (!reqs)
+		return -1;
+
+	start = nlbench_now();
+	for (i = 0; i < n && rc != -1; i++) {
+		rc = nlbench_submit(op, ifindex, prefix, i, &reqs[i]);
+		/* one round trip per request */
+		if (rc != -1 && !batched)
+			rc = netlink_sync();
+	}
+
+	if (rc != -1)
+		rc = netlink_sync();
+
+	if (rc != -1)
+		nlbench_report(op, batched, n, reqs, nlbench_now() - start);
+
+	free(reqs);
+	return rc;
+}
+
+/* rtnetlink by hand, netlink.c has no business creating links */
+static int nlbench_link(uint16_t type, uint16_t flags)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_socket *sk;
+	struct nlattr *linkinfo;
+	struct ifinfomsg *ifm;
+	struct nlmsghdr *nlh;
+	int rc;
+
+	sk = mnl_socket_open(NETLINK_ROUTE);
+	if (!sk)
+		return -1;
+
+	rc = mnl_socket_bind(sk, 0, MNL_SOCKET_AUTOPID);
+	if (rc < 0)
+		goto out;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	nlh->nlmsg_seq = 1;
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
+	ifm->ifi_family = AF_UNSPEC;
+	ifm->ifi_flags = IFF_UP;
+	ifm->ifi_change = IFF_UP;
+
+	mnl_attr_put_strz(nlh, IFLA_IFNAME, NLBENCH_IFNAME);
+	linkinfo = mnl_attr_nest_start(nlh, IFLA_LINKINFO);
+	mnl_attr_put_strz(nlh, IFLA_INFO_KIND, "dummy");
+	mnl_attr_nest_end(nlh, linkinfo);
+
+	rc = mnl_socket_sendto(sk, nlh, nlh->nlmsg_len);
+	if (rc < 0)
+		goto out;
+
+	rc = mnl_socket_recvfrom(sk, buf, sizeof(buf));
+	if (rc < 0)
+		goto out;
+
+	rc = mnl_cb_run(buf, rc, 1, mnl_socket_get_portid(sk), NULL, NULL);
+
+out:
+	if (rc < 0)
+		perror("nlbench link");
+
+	mnl_socket_close(sk);
+	return rc < 0 ? -1 : 0;
+}
+
+/* fresh interface per size, its removal takes everything along */
+static int nlbench_size(uint32_t n)
+{
+	static uint16_t prefix;
+	uint32_t ifindex;
+	int rc;
+
+	rc = nlbench_link(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL);
+	if (rc == -1)
+		return -1;
+
+	ifindex = if_nametoindex(NLBENCH_IFNAME);
+	if (!ifindex)
+		return -1;
+
+	rc = nl_set_route_table(ifindex, DEFAULT_RT_TABLE, DEFAULT_RT_PROTO);
+	if (rc == -1)
+		return -1;
+
+	rc = nlbench_run(NLBENCH_ADD_ROUTE, false, ifindex, ++prefix, n);
+	if (rc != -1)
+		rc = nlbench_run(NLBENCH_DEL_ROUTE, false, ifindex, prefix, n);
+	if (rc != -1)
+		rc = nlbench_run(NLBENCH_ADD_ROUTE, true, ifindex, ++prefix, n);
+	if (rc != -1)
+		rc = nlbench_run(NLBENCH_DEL_ROUTE, true, ifindex, prefix, n);
+	if (rc != -1)
+		rc = nlbench_run(NLBENCH_ADD_ADDR, false, ifindex, ++prefix, n);
+	if (rc != -1)
+		rc = nlbench_run(NLBENCH_ADD_ADDR, true, ifindex, ++prefix, n);
+
+	nl_unset_route_table(ifindex);
+	netlink_sync();
+
+	if (nlbench_link(RTM_DELLINK, 0) == -1)
+		return -1;
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[] = { 1000, 10000, 100000 };
+	struct ev_loop *loop = EV_DEFAULT;
+	unsigned long n;
+	int i, rc = 0;
+
+	log_open(L_STDERR, argv[0], NULL, LOG_DAEMON);
+
+	if (unshare(CLONE_NEWNET) == -1) {
+		perror("unshare, needs to run as root");
+		return NLBENCH_SKIP;
+	}
+
+	if (netlink_open(loop) == -1)
+		return 1;
+
+	printf("%-17s %-8s %7s %9s %10s %9s %9s %9s %9s %6s\n",
+	       "op", "mode", "n", "total[s]", "ops/s", "p50[us]", "p90[us]",
+	       "p99[us]", "max[us]", "errors");
+
+	if (argc == 1) {
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && rc != -1; i++)
+			rc = nlbench_size(sizes[i]);
+	}
+
+	for (i = 1; i < argc && rc != -1; i++) {
+		n = strtoul(argv[i], NULL, 10);
+		if (!n || n > UINT32_MAX) {
+			fprintf(stderr, "invalid size %s\n", argv[i]);
+			rc = -1;
+			break;
+		}
+
+		rc = nlbench_size(n);
+	}
+
+	netlink_close();
+	log_close();
+
+	return rc == -1 ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "siphash.h"
+#include "pool.h"
+#include "child.h"
+
+/* must be a power of two */
+#define CHILD_TABLE_MIN_SLOTS	16
+
+struct pool child_pool = POOL_INIT("child", struct child);
+
+static struct siphash_key child_key;
+
+/* once at startup, before any table is used */
+int child_hash_init(void)
+{
+	return siphash_key_init(&child_key);
+}
+
+static uint64_t child_hash(const struct in6_addr *addr)
+{
+	return siphash(addr, sizeof(*addr), &child_key);
+}
+
+/* slot of the entry idx, the entry must be in the table */
+static uint32_t child_table_slot(const struct child_table *t, uint32_t idx)
+{
+	uint32_t i = t->entries[idx]->hash & t->mask;
+
+	while (t->slots[i] != idx + 1)
+		i = (i + 1) & t->mask;
+
+	return i;
+}
+
+static int child_table_resize(struct child_table *t, uint32_t nslots)
+{
+	struct child **entries;
+	uint32_t *slots;
+	uint32_t i, j;
+
+	slots = calloc(nslots, sizeof(*slots));
+	if (!slots)
+		return -1;
+
+	/* at most half of the slots are used */
+	entries = realloc(t->entries, (nslots / 2) * sizeof(*entries));
+	if (!entries) {
+		free(slots);
+		return -1;
+	}
+
+	t->entries = entries;
+	t->size = nslots / 2;
+	free(t->slots);
+	t->slots = slots;
+	t->mask = nslots - 1;
+
+	for (i = 0; i < t->count; i++) {
+		j = t->entries[i]->hash & t->mask;
+		while (t->slots[j])
+			j = (j + 1) & t->mask;
+
+		t->slots[j] = i + 1;
+	}
+
+	return 0;
+}
+
+/* returns the slot of addr or -1 */
+static int64_t child_table_find(const struct child_table *t,
+				const struct in6_addr *addr)
+{
+	const struct child *child;
+	uint64_t hash;
+	uint32_t i;
+
+	if (!t->count)
+		return -1;
+
+	hash = child_hash(addr);
+	for (i = hash & t->mask; t->slots[i]; i = (i + 1) & t->mask) {
+		child = t->entries[t->slots[i] - 1];
+		if (child->hash == hash &&
+		    !memcmp(&child->addr, addr, sizeof(*addr)))
+			return i;
+	}
+
+	return -1;
+}
+
+struct child *child_table_lookup(const struct child_table *t,
+				 const struct in6_addr *addr)
+{
+	int64_t i;
+
+	i = child_table_find(t, addr);
+	if (i == -1)
+		return NULL;
+
+	return t->entries[t->slots[i] - 1];
+}
+
+/* the caller checks for duplicates */
+int child_table_insert(struct child_table *t, struct child *child)
+{
+	uint32_t i;
+
+	/* grow at a load factor of one half */
+	if (t->count == t->size &&
+	    child_table_resize(t, t->mask ? (t->mask + 1) * 2 :
+			       CHILD_TABLE_MIN_SLOTS) == -1)
+		return -1;
+
+	child->hash = child_hash(&child->addr);
+	for (i = child->hash & t->mask; t->slots[i]; i = (i + 1) & t->mask)
+		;
+
+	t->entries[t->count] = child;
+	t->slots[i] = ++t->count;
+
+	return 0;
+}
+
+/* backward shift deletion, linear probing needs no tombstones then */
+static void child_table_clear_slot(struct child_table *t, uint32_t i)
+{
+	uint32_t j = i, home;
+
+	while (1) {
+		j = (j + 1) & t->mask;
+		if (!t->slots[j])
+			break;
+
+		home = t->entries[t->slots[j] - 1]->hash & t->mask;
+		/* j can't move to i if its home is cyclically in (i, j] */
+		if ((j > i && (home <= i || home > j)) ||
+		    (j < i && (home <= i && home > j))) {
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+
+	t->slots[i] = 0;
+}
+
+struct child *child_table_remove(struct child_table *t,
+				 const struct in6_addr *addr)
+{
+	struct child *child;
+	uint32_t idx, last;
+	int64_t i;
+
+	i = child_table_find(t, addr);
+	if (i == -1)
+		return NULL;
+
+	idx = t->slots[i] - 1;
+	child = t->entries[idx];
+	child_table_clear_slot(t, i);
+
+	/* keep entries dense, the last one takes the hole */
+	last = --t->count;
+	if (idx != last) {
+		t->slots[child_table_slot(t, last)] = idx + 1;
+		t->entries[idx] = t->entries[last];
+	}
+
+	/* shrink at a load factor of one eighth */
+	if (t->mask + 1 > CHILD_TABLE_MIN_SLOTS && t->count < t->size / 4)
+		child_table_resize(t, (t->mask + 1) / 2);
+
+	return child;
+}
+
+void child_table_flush(struct child_table *t)
+{
+	uint32_t i;
+
+	for (i = 0; i < t->count; i++)
+		pool_free(&child_pool, t->entries[i]);
+
+	t->count = 0;
+	if (t->slots)
+		memset(t->slots, 0, (t->mask + 1) * sizeof(*t->slots));
+}
+
+void child_table_free(struct child_table *t)
+{
+	child_table_flush(t);
+	free(t->entries);
+	free(t->slots);
+	memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,63 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_CHILD_H__
+#define __RPLD_CHILD_H__
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "topo.h"
+
+struct child {
+	struct in6_addr addr;
+	/* nexthop, in non-storing mode the parent of the transit option */
+	struct in6_addr from;
+
+	/* keyed hash of addr, saves rehashing on growth */
+	uint64_t hash;
+
+	/* non-storing root only */
+	struct topo_node topo;
+};
+
+/*
+ * Children of a dag by address. Open addressing with linear probing over
+ * a power of two slot array, a slot holds the index + 1 into the dense
+ * entries array, 0 is free. Iteration only walks entries.
+ */
+struct child_table {
+	struct child **entries;
+	uint32_t count;
+	uint32_t size;
+
+	uint32_t *slots;
+	uint32_t mask;
+};
+
+extern struct pool child_pool;
+
+#define child_table_foreach(t, c, i) \
+	for ((i) = 0; (i) < (t)->count && ((c) = (t)->entries[(i)]); (i)++)
+
+int child_hash_init(void);
+struct child *child_table_lookup(const struct child_table *t,
+				 const struct in6_addr *addr);
+int child_table_insert(struct child_table *t, struct child *child);
+struct child *child_table_remove(struct child_table *t,
+				 const struct in6_addr *addr);
+void child_table_flush(struct child_table *t);
+void child_table_free(struct child_table *t);
+
+#endif /* __RPLD_CHILD_H__ */
@@ -11,7 +11,6 @@
  */
 
 #include <sys/types.h>
-#include <ifaddrs.h>
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -20,77 +19,10 @@
 #include "helpers.h"
 #include "netlink.h"
 #include "config.h"
+#include "rpl.h"
+#include "of.h"
 #include "log.h"
 
-static inline int cmp_iface_addrs(void const *a, void const *b)
-{
-	return memcmp(a, b, sizeof(struct in6_addr));
-}
-
-/*
- * Return first IPv6 link local addr in if_addr.
- * Return all the IPv6 addresses in if_addrs in ascending
- * order.
- * Return value is -1 if there was no link local addr.
- * otherwise return value is count of addres in if_addrs
- * not including the all zero (unspecified) addr at the
- * end of the list.
- */
-static int get_iface_addrs(char const *name, struct in6_addr *if_addr,
-			   struct in6_addr **if_addrs)
-{
-	struct ifaddrs *addresses = 0;
-	int link_local_set = 0;
-	int i = 0;
-
-	if (getifaddrs(&addresses) != 0) {
-		flog(LOG_ERR, "getifaddrs failed on %s: %s", name, strerror(errno));
-	} else {
-		for (struct ifaddrs *ifa = addresses; ifa != NULL; ifa = ifa->ifa_next) {
-
-			if (!ifa->ifa_addr)
-				continue;
-
-			if (ifa->ifa_addr->sa_family != AF_INET6)
-				continue;
-
-			struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)ifa->ifa_addr;
-
-			/* Skip if it is not the interface we're looking for. */
-			if (strcmp(ifa->ifa_name, name) != 0)
-				continue;
-
-			*if_addrs = realloc(*if_addrs, (i + 1) * sizeof(struct in6_addr));
-			(*if_addrs)[i++] = a6->sin6_addr;
-
-			/* Skip if it is not a linklocal address or link locak address already found*/
-			uint8_t const ll_prefix[] = {0xfe, 0x80, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
-			if (link_local_set || 0 != memcmp(&(a6->sin6_addr), ll_prefix, sizeof(ll_prefix)))
-				continue;
-
-			if (if_addr)
-				memcpy(if_addr, &(a6->sin6_addr), sizeof(struct in6_addr));
-
-			link_local_set = 1;
-		}
-	}
-
-	if (addresses)
-		freeifaddrs(addresses);
-
-	/* last item in the list is all zero (unspecified) address */
-	*if_addrs = realloc(*if_addrs, (i + 1) * sizeof(struct in6_addr));
-	memset(&(*if_addrs)[i], 0, sizeof(struct in6_addr));
-
-	/* Sort the addresses so the output is predictable. */
-	qsort(*if_addrs, i, sizeof(struct in6_addr), cmp_iface_addrs);
-
-	if (!link_local_set)
-		return -1;
-
-	return i;
-}
-
 static int parse_ipv6_prefix(struct in6_prefix *prefix, const char *str)
 {
 	char ip[INET6_ADDRSTRLEN] = {};
@@ -137,20 +69,106 @@ struct dag *iface_find_dag(const struct list_head *dags, uint16_t inst_id)
 }
 #endif
 
-struct iface *iface_find_by_ifindex(const struct list_head *ifaces,
-				    uint32_t ifindex)
+/* ifaces indexed by ifindex, the RX path hits it for every packet */
+static struct iface **iface_by_index;
+static uint32_t iface_by_index_size;
+
+struct iface *iface_find_by_ifindex(uint32_t ifindex)
 {
-	struct iface *iface;
-	struct list *e;
+	if (ifindex >= iface_by_index_size)
+		return NULL;
 
-	DL_FOREACH(ifaces->head, e) {
-		iface = container_of(e, struct iface, list);
+	return iface_by_index[ifindex];
+}
+
+static int iface_index_add(struct iface *iface)
+{
+	struct iface **table;
+	uint32_t size;
 
-		if (iface->ifindex == ifindex)
-			return iface;
+	if (iface->ifindex >= iface_by_index_size) {
+		size = iface->ifindex + 1;
+		table = realloc(iface_by_index, size * sizeof(*table));
+		if (!table)
+			return -1;
+
+		memset(&table[iface_by_index_size], 0,
+		       (size - iface_by_index_size) * sizeof(*table));
+		iface_by_index = table;
+		iface_by_index_size = size;
 	}
 
-	return NULL;
+	if (iface_by_index[iface->ifindex])
+		return -1;
+
+	iface_by_index[iface->ifindex] = iface;
+	return 0;
+}
+
+/*
+ * Take llinfo and addresses from the link cache.
+ * ifaddr is the first IPv6 link local addr, ifaddrs all the
+ * IPv6 addresses in ascending order with the all zero
+ * (unspecified) addr at the end of the list.
+ * Return value is -1 if there was no link local addr, the
+ * iface is not touched then.
+ */
+static int iface_update_link(struct iface *iface, const struct nl_link *link)
+{
+	uint8_t const ll_prefix[] = {0xfe, 0x80, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
+	unsigned char *lladdr = NULL;
+	struct in6_addr *addrs;
+	int i, ll = -1;
+
+	for (i = 0; i < link->addrs_count; i++) {
+		if (!memcmp(&link->addrs[i], ll_prefix, sizeof(ll_prefix))) {
+			ll = i;
+			break;
+		}
+	}
+
+	if (ll == -1)
+		return -1;
+
+	if (link->llinfo.addr_len) {
+		lladdr = mzalloc(link->llinfo.addr_len);
+		if (!lladdr)
+			return -1;
+
+		memcpy(lladdr, link->llinfo.addr, link->llinfo.addr_len);
+	}
+
+	addrs = realloc(iface->ifaddrs,
+			(link->addrs_count + 1) * sizeof(*addrs));
+	if (!addrs) {
+		free(lladdr);
+		return -1;
+	}
+
+	memcpy(addrs, link->addrs, link->addrs_count * sizeof(*addrs));
+	memset(&addrs[link->addrs_count], 0, sizeof(*addrs));
+	iface->ifaddrs = addrs;
+	iface->ifaddrs_count = link->addrs_count;
+	iface->ifaddr = link->addrs[ll];
+
+	free(iface->llinfo.addr);
+	iface->llinfo = link->llinfo;
+	iface->llinfo.addr = lladdr;
+
+	return 0;
+}
+
+void iface_link_cb(const struct nl_link *link, void *data)
+{
+	struct iface *iface;
+
+	iface = iface_find_by_ifindex(link->ifindex);
+	if (!iface)
+		return;
+
+	if (iface_update_link(iface, link) == -1)
+		flog(LOG_WARNING, "%s has no link local address, keep old state",
+		     iface->ifname);
 }
 
 static struct iface *iface_create()
@@ -171,14 +189,30 @@ static void iface_free(struct iface *iface)
 	free(iface);
 }
 
+/* the DIOIntervalMin to a trickle_t in seconds, rounded up */
+static uint8_t config_trickle_t_to_int_min(ev_tstamp trickle_t)
+{
+	uint8_t int_min = 0;
+
+	while (int_min < 32 && (1ULL << int_min) < trickle_t * 1000)
+		int_min++;
+
+	return int_min;
+}
+
 static int config_load_dags(lua_State *L, struct iface *iface,
 			    uint8_t instanceid)
 {
+	uint16_t min_hop_rank_inc, max_rank_inc, lifetime_unit;
+	uint8_t int_min, doublings, redundancy;
+	uint8_t default_lifetime;
 	struct in6_addr dodagid;
+	const struct of *of;
 	struct in6_prefix dest;
-	ev_tstamp trickle_t;
 	uint8_t version;
 	struct dag *dag;
+	uint8_t metric;
+	uint8_t mop;
 	int rc;
 
 	lua_getfield(L, -1, "dags");
@@ -199,11 +233,33 @@ static int config_load_dags(lua_State *L, struct iface *iface,
 		}
 		lua_pop(L, 1);
 
+		/* Imin in seconds, dio_interval_min wins */
 		lua_getfield(L, -1, "trickle_t");
 		if (lua_isnumber(L, -1)) {
-			trickle_t = lua_tonumber(L, -1);
+			int_min = config_trickle_t_to_int_min(lua_tonumber(L, -1));
 		} else {
-			trickle_t = DEFAULT_TICKLE_T;
+			int_min = DEFAULT_DIO_INTERVAL_MIN;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "dio_interval_min");
+		if (lua_isnumber(L, -1))
+			int_min = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "dio_interval_doublings");
+		if (lua_isnumber(L, -1)) {
+			doublings = lua_tonumber(L, -1);
+		} else {
+			doublings = DEFAULT_DIO_INTERVAL_DOUBLINGS;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "dio_redundancy");
+		if (lua_isnumber(L, -1)) {
+			redundancy = lua_tonumber(L, -1);
+		} else {
+			redundancy = DEFAULT_DIO_REDUNDANCY;
 		}
 		lua_pop(L, 1);
 
@@ -228,13 +284,96 @@ static int config_load_dags(lua_State *L, struct iface *iface,
 		}
 		lua_pop(L, 1);
 
+		lua_getfield(L, -1, "objective_function");
+		if (lua_isstring(L, -1)) {
+			of = of_lookup_name(lua_tostring(L, -1));
+			if (!of)
+				return -1;
+		} else {
+			of = of_lookup(RPL_OCP_OF0);
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "min_hop_rank_increase");
+		if (lua_isnumber(L, -1)) {
+			min_hop_rank_inc = lua_tonumber(L, -1);
+			if (!min_hop_rank_inc)
+				return -1;
+		} else {
+			min_hop_rank_inc = RPL_DEFAULT_MIN_HOP_RANK_INCREASE;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "max_rank_increase");
+		if (lua_isnumber(L, -1)) {
+			max_rank_inc = lua_tonumber(L, -1);
+		} else {
+			max_rank_inc = DEFAULT_MAX_RANK_INCREASE;
+		}
 		lua_pop(L, 1);
 
+		lua_getfield(L, -1, "default_lifetime");
+		if (lua_isnumber(L, -1)) {
+			default_lifetime = lua_tonumber(L, -1);
+		} else {
+			default_lifetime = DEFAULT_DEFAULT_LIFETIME;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "lifetime_unit");
+		if (lua_isnumber(L, -1)) {
+			lifetime_unit = lua_tonumber(L, -1);
+		} else {
+			lifetime_unit = DEFAULT_LIFETIME_UNIT;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "mode");
+		if (lua_isstring(L, -1)) {
+			if (!strcmp(lua_tostring(L, -1), "non-storing"))
+				mop = RPL_DIO_NONSTORING;
+			else if (!strcmp(lua_tostring(L, -1), "storing"))
+				mop = RPL_DIO_STORING_NO_MULTICAST;
+			else
+				return -1;
+		} else {
+			mop = RPL_DIO_STORING_NO_MULTICAST;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "metric");
+		if (lua_isstring(L, -1)) {
+			if (!strcmp(lua_tostring(L, -1), "etx"))
+				metric = RPL_MC_ETX;
+			else if (!strcmp(lua_tostring(L, -1), "latency"))
+				metric = RPL_MC_LATENCY;
+			else if (!strcmp(lua_tostring(L, -1), "hop-count"))
+				metric = RPL_MC_HC;
+			else
+				return -1;
+		} else {
+			metric = RPL_MC_NONE;
+		}
+		lua_pop(L, 1);
+
+		lua_pop(L, 1);
+
+		/* the root rank is one MinHopRankIncrease */
 		dag = dag_create(iface, instanceid, &dodagid,
-				 trickle_t, 1, version, &dest);
+				 min_hop_rank_inc, version, &dest);
 		if (!dag)
 			return -1;
 
+		dag->of = of;
+		dag->mop = mop;
+		dag->metric = metric;
+		dag->min_hop_rank_inc = min_hop_rank_inc;
+		dag->max_rank_inc = max_rank_inc;
+		dag->default_lifetime = default_lifetime;
+		dag->lifetime_unit = lifetime_unit;
+		dag_set_trickle(dag, int_min, doublings, redundancy);
+		trickle_start(&dag->trickle);
+
 		/* we are root, self is dodagid */
 		memcpy(&dag->self, &dodagid, sizeof(dag->self));
 	}
@@ -243,6 +382,29 @@ static int config_load_dags(lua_State *L, struct iface *iface,
 	return 0;
 }
 
+static void config_load_pool(lua_State *L, const char *name,
+			     struct pool *pool)
+{
+	lua_getfield(L, -1, name);
+	if (lua_isnumber(L, -1) &&
+	    pool_prealloc(pool, lua_tonumber(L, -1)) == -1)
+		flog(LOG_WARNING, "failed to preallocate %s", name);
+	lua_pop(L, 1);
+}
+
+/* optional, objects which are taken anyway at runtime */
+static void config_load_pools(lua_State *L)
+{
+	lua_getglobal(L, "pools");
+	if (lua_istable(L, -1)) {
+		config_load_pool(L, "dags", &dag_pool);
+		config_load_pool(L, "peers", &peer_pool);
+		config_load_pool(L, "childs", &child_pool);
+		config_load_pool(L, "neighs", &neigh_pool);
+	}
+	lua_pop(L, 1);
+}
+
 static int config_load_instances(lua_State *L, struct iface *iface)
 {
 	uint8_t instanceid;
@@ -274,6 +436,7 @@ static int config_load_instances(lua_State *L, struct iface *iface)
 
 int config_load(const char *filename, struct list_head *ifaces)
 {
+	const struct nl_link *link;
 	struct iface *iface;
 	lua_State *L;
 	int rc;
@@ -293,6 +456,17 @@ int config_load(const char *filename, struct list_head *ifaces)
 		return -1;
 	}
 
+	config_load_pools(L);
+
+	lua_getglobal(L, "timer_tick");
+	if (lua_isnumber(L, -1) &&
+	    wheel_set_tick(lua_tonumber(L, -1)) == -1) {
+		flog(LOG_ERR, "invalid timer_tick");
+		lua_close(L);
+		return -1;
+	}
+	lua_pop(L, 1);
+
 	lua_getglobal(L, "ifaces");
 	if (!lua_istable(L, -1))
 		return -1;
@@ -331,18 +505,19 @@ int config_load(const char *filename, struct list_head *ifaces)
 			return -1;
 		}
 
-		iface->ifindex = if_nametoindex(iface->ifname);
-		if (iface->ifindex == 0) {
-			flog(LOG_ERR, "%s not found: %s", iface->ifname, strerror(errno));
+		link = nl_link_lookup(iface->ifname);
+		if (!link) {
+			flog(LOG_ERR, "%s not found", iface->ifname);
 			iface_free(iface);
 			lua_close(L);
 			return -1;
 		}
+		iface->ifindex = link->ifindex;
 
-		nl_get_llinfo(iface->ifindex, &iface->llinfo);
-
-		rc = get_iface_addrs(iface->ifname, &iface->ifaddr, &iface->ifaddrs);
+		rc = iface_update_link(iface, link);
 		if (rc == -1) {
+			flog(LOG_ERR, "%s has no link local address",
+			     iface->ifname);
 			iface_free(iface);
 			lua_close(L);
 			return rc;
@@ -350,7 +525,6 @@ int config_load(const char *filename, struct list_head *ifaces)
 
 		/* TODO because compression might be different here... */
 		iface->ifaddr_src = &iface->ifaddr;
-		iface->ifaddrs_count = rc;
 
 		lua_getfield(L, -1, "dodag_root");
 		if (!lua_isboolean(L, -1)) {
@@ -362,6 +536,53 @@ int config_load(const char *filename, struct list_head *ifaces)
 		iface->dodag_root = lua_toboolean(L, -1);
 		lua_pop(L, 1);
 
+		lua_getfield(L, -1, "rt_table");
+		if (lua_isnumber(L, -1)) {
+			iface->rt_table = lua_tonumber(L, -1);
+		} else {
+			iface->rt_table = DEFAULT_RT_TABLE;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "rt_proto");
+		if (lua_isnumber(L, -1)) {
+			iface->rt_proto = lua_tonumber(L, -1);
+		} else {
+			iface->rt_proto = DEFAULT_RT_PROTO;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "warm_restart");
+		if (lua_isboolean(L, -1))
+			iface->warm_restart = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "energy");
+		if (lua_isstring(L, -1)) {
+			if (!strcmp(lua_tostring(L, -1), "mains")) {
+				iface->energy = RPL_MC_NE_MAINS;
+			} else if (!strcmp(lua_tostring(L, -1), "battery")) {
+				iface->energy = RPL_MC_NE_BATTERY;
+			} else if (!strcmp(lua_tostring(L, -1), "scavenger")) {
+				iface->energy = RPL_MC_NE_SCAVENGER;
+			} else {
+				iface_free(iface);
+				lua_close(L);
+				return -1;
+			}
+		} else {
+			iface->energy = RPL_MC_NE_MAINS;
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "latency");
+		if (lua_isnumber(L, -1)) {
+			iface->latency = lua_tonumber(L, -1);
+		} else {
+			iface->latency = DEFAULT_LATENCY;
+		}
+		lua_pop(L, 1);
+
 		if (iface->dodag_root) {
 			rc = config_load_instances(L, iface);
 			if (rc == -1)
@@ -369,6 +590,15 @@ int config_load(const char *filename, struct list_head *ifaces)
 		}
 
 		lua_pop(L, 1);
+
+		rc = iface_index_add(iface);
+		if (rc == -1) {
+			flog(LOG_ERR, "%s configured twice", iface->ifname);
+			iface_free(iface);
+			lua_close(L);
+			return -1;
+		}
+
 		DL_APPEND(ifaces->head, &iface->list);
 	}
 
@@ -391,4 +621,8 @@ void config_free(struct list_head *ifaces)
 
 		DL_DELETE(ifaces->head, e);
 	}
+
+	free(iface_by_index);
+	iface_by_index = NULL;
+	iface_by_index_size = 0;
 }
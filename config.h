@@ -19,13 +19,32 @@
 #include <net/if.h>
 #include <stdint.h>
 
+#include "lowpan.h"
+#include "wheel.h"
 #include "dag.h"
 #include "list.h"
 
 #define MAX_RPL_INSTANCEID	UINT8_MAX
-#define DEFAULT_TICKLE_T	5
+/* RFC 6550 18.2, the trickle Imin is 2^3 ms */
+#define DEFAULT_DIO_INTERVAL_MIN	3
+#define DEFAULT_DIO_INTERVAL_DOUBLINGS	20
+#define DEFAULT_DIO_REDUNDANCY		10
+/* no limit, the lifetime of routes is infinite */
+#define DEFAULT_MAX_RANK_INCREASE	0
+#define DEFAULT_DEFAULT_LIFETIME	0xff
+#define DEFAULT_LIFETIME_UNIT		0xffff
 #define DEFAULT_DAG_VERSION	1
 
+/* of a transmission in microseconds, for the latency metric */
+#define DEFAULT_LATENCY		10000
+/* RFC 6550, to tell our routes apart */
+#define DEFAULT_RT_TABLE	6550
+#define DEFAULT_RT_PROTO	65
+/* seconds routes of a previous run wait for their DAO */
+#define DEFAULT_RECONCILE_GRACE	60
+/* resolution of all protocol timers in seconds */
+#define DEFAULT_TIMER_TICK	0.1
+
 struct iface_llinfo {
 	unsigned char *addr;
 	uint8_t addr_len;
@@ -36,7 +55,7 @@ struct iface {
 	char ifname[IFNAMSIZ];
 	uint32_t ifindex;
 
-	ev_timer dis_w;
+	struct wheel_timer dis_w;
 	struct iface_llinfo llinfo;
 
 	struct in6_addr ifaddr;
@@ -45,15 +64,35 @@ struct iface {
 	struct in6_addr *ifaddr_src;
 
 	struct list_head rpls;
+	/* rpls indexed by instance id */
+	struct rpl *rpl_by_id[UINT8_MAX + 1];
 	bool dodag_root;
 
+	/* routing table and rtm_protocol of our routes */
+	uint32_t rt_table;
+	uint8_t rt_proto;
+	/* keep routes at exit, the next start adopts them */
+	bool warm_restart;
+
+	/* RFC 6551 node metrics, RPL_MC_NE_* and microseconds */
+	uint8_t energy;
+	uint32_t latency;
+
+	/* arena of the messages we build, one at a time and sent at once */
+	unsigned char tx[ENC_MTU];
+
+	/* stateful header compression, index is the context id */
+	struct lowpan_ctx ctxs[LOWPAN_CTX_MAX];
+
 	struct list list;
 };
 
+struct nl_link;
+
 int config_load(const char *filename, struct list_head *ifaces);
 void config_free(struct list_head *ifaces);
 
-struct iface *iface_find_by_ifindex(const struct list_head *ifaces,
-				    uint32_t ifindex);
+struct iface *iface_find_by_ifindex(uint32_t ifindex);
+void iface_link_cb(const struct nl_link *link, void *data);
 
 #endif /* __RPLD_CONFIG__ */
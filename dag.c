@@ -15,33 +15,239 @@
 
 #include <linux/ipv6.h>
 #include <netinet/icmp6.h>
+#include <stddef.h>
 
 #include "helpers.h"
 #include "netlink.h"
-#include "buffer.h"
+#include "siphash.h"
+#include "enc.h"
 #include "rpl.h"
 #include "dag.h"
+#include "of.h"
 
-struct peer *dag_peer_create(const struct in6_addr *addr)
+struct pool dag_pool = POOL_INIT("dag", struct dag);
+struct pool peer_pool = POOL_INIT("peer", struct peer);
+
+static struct peer *dag_peer_create(const struct dag *dag,
+				    const struct in6_addr *addr)
 {
 	struct peer *peer;
 
-	peer = mzalloc(sizeof(*peer));
+	peer = pool_alloc(&peer_pool);
 	if (!peer)
 		return NULL;
 
+	peer->neigh = neigh_get(dag->iface->ifindex, addr);
+	if (!peer->neigh) {
+		pool_free(&peer_pool, peer);
+		return NULL;
+	}
+
 	memcpy(&peer->addr, addr, sizeof(peer->addr));
-	peer->rank = UINT16_MAX;
+	peer->rank = RPL_INFINITE_RANK;
 
 	return peer;
 }
 
+static void dag_peer_free(struct peer *peer)
+{
+	neigh_put(peer->neigh);
+	pool_free(&peer_pool, peer);
+}
+
+static struct peer *dag_lookup_candidate(const struct dag *dag,
+					 const struct in6_addr *addr)
+{
+	struct peer *peer;
+	struct list *p;
+
+	DL_FOREACH(dag->candidates.head, p) {
+		peer = container_of(p, struct peer, list);
+
+		if (dag_is_peer(peer, addr))
+			return peer;
+	}
+
+	return NULL;
+}
+
+static void dag_del_candidate(struct dag *dag, struct peer *peer)
+{
+	if (dag->parent == peer)
+		dag->parent = NULL;
+
+	DL_DELETE(dag->candidates.head, &peer->list);
+	dag->candidates_count--;
+	dag_peer_free(peer);
+}
+
+static void dag_flush_candidates(struct dag *dag)
+{
+	struct list *p, *tmp;
+
+	DL_FOREACH_SAFE(dag->candidates.head, p, tmp)
+		dag_del_candidate(dag, container_of(p, struct peer, list));
+}
+
+/*
+ * Orders the candidates, the smaller the better. Relays on battery or
+ * scavenged energy are only taken if there is nothing else.
+ */
+static uint64_t dag_peer_key(const struct dag *dag, const struct peer *peer)
+{
+	uint64_t key = dag->of->cost(dag, peer);
+
+	if (peer->mc.energy != RPL_MC_NE_MAINS)
+		key |= 1ULL << 32;
+
+	return key;
+}
+
+/* the worst one to have, never the parent */
+static struct peer *dag_worst_candidate(const struct dag *dag)
+{
+	struct peer *peer, *worst = NULL;
+	uint64_t key, worst_key = 0;
+	struct list *p;
+
+	DL_FOREACH(dag->candidates.head, p) {
+		peer = container_of(p, struct peer, list);
+		if (peer == dag->parent)
+			continue;
+
+		key = dag_peer_key(dag, peer);
+		if (!worst || key >= worst_key) {
+			worst = peer;
+			worst_key = key;
+		}
+	}
+
+	return worst;
+}
+
+/* a dio without metric container updates the candidate with mc NULL */
+int dag_update_candidate(struct dag *dag, const struct in6_addr *addr,
+			 uint16_t rank, const struct dag_metrics *mc)
+{
+	struct peer *peer, *worst;
+
+	peer = dag_lookup_candidate(dag, addr);
+	if (rank == RPL_INFINITE_RANK) {
+		if (peer)
+			dag_del_candidate(dag, peer);
+
+		return 0;
+	}
+
+	if (!peer) {
+		peer = dag_peer_create(dag, addr);
+		if (!peer)
+			return -1;
+
+		peer->rank = rank;
+		if (mc)
+			peer->mc = *mc;
+
+		if (dag->candidates_count == DAG_MAX_CANDIDATES) {
+			/* replace the worst if the new one is better */
+			worst = dag_worst_candidate(dag);
+			if (!worst || dag_peer_key(dag, peer) >=
+				      dag_peer_key(dag, worst)) {
+				dag_peer_free(peer);
+				return 0;
+			}
+
+			dag_del_candidate(dag, worst);
+		}
+
+		DL_APPEND(dag->candidates.head, &peer->list);
+		dag->candidates_count++;
+	}
+
+	peer->rank = rank;
+	if (mc)
+		peer->mc = *mc;
+	else
+		memset(&peer->mc, 0, sizeof(peer->mc));
+
+	return 0;
+}
+
+/*
+ * Pick the preferred parent by the objective function, true if the
+ * parent or our rank changed. A candidate of our rank or greater could
+ * be our own child, only the current parent is taken then. A rank more
+ * than MaxRankIncrease above our lowest in this version is not allowed,
+ * RFC 6550 8.2.2.4.
+ */
+bool dag_select_parent(struct dag *dag)
+{
+	uint16_t rank, best_rank = RPL_INFINITE_RANK;
+	char addr_str[INET6_ADDRSTRLEN];
+	struct peer *peer, *best = NULL;
+	uint64_t key, best_key = 0;
+	uint32_t max_rank;
+	struct list *p;
+	bool changed;
+
+	max_rank = RPL_INFINITE_RANK;
+	if (dag->max_rank_inc && dag->lowest_rank != RPL_INFINITE_RANK)
+		max_rank = dag->lowest_rank + dag->max_rank_inc;
+
+	DL_FOREACH(dag->candidates.head, p) {
+		peer = container_of(p, struct peer, list);
+		if (peer != dag->parent && peer->rank >= dag->my_rank)
+			continue;
+
+		rank = dag->of->rank(dag, peer);
+		if (rank == RPL_INFINITE_RANK || rank > max_rank)
+			continue;
+
+		key = dag_peer_key(dag, peer);
+		if (!best || key < best_key) {
+			best = peer;
+			best_rank = rank;
+			best_key = key;
+		}
+	}
+
+	/* hysteresis, unless the parent is worse powered */
+	if (best && dag->parent && best != dag->parent &&
+	    dag->of->rank(dag, dag->parent) != RPL_INFINITE_RANK &&
+	    dag_peer_key(dag, dag->parent) >> 32 <= best_key >> 32 &&
+	    !dag->of->better(dag, dag->parent, best)) {
+		best = dag->parent;
+		best_rank = dag->of->rank(dag, best);
+	}
+
+	changed = best != dag->parent || best_rank != dag->my_rank;
+	if (best != dag->parent) {
+		if (best) {
+			addrtostr(&best->addr, addr_str, sizeof(addr_str));
+			flog(LOG_INFO, "preferred parent %s rank %u",
+			     addr_str, best_rank);
+		} else {
+			flog(LOG_INFO, "no preferred parent left");
+		}
+	}
+
+	if (best_rank != dag->my_rank)
+		dag_dio_invalidate(dag);
+
+	dag->parent = best;
+	dag->my_rank = best_rank;
+	if (best_rank < dag->lowest_rank)
+		dag->lowest_rank = best_rank;
+
+	return changed;
+}
+
 struct child *dag_child_create(const struct in6_addr *addr,
 			       const struct in6_addr *from)
 {
 	struct child *peer;
 
-	peer = mzalloc(sizeof(*peer));
+	peer = pool_alloc(&child_pool);
 	if (!peer)
 		return NULL;
 
@@ -59,59 +265,181 @@ bool dag_is_peer(const struct peer *peer, const struct in6_addr *addr)
 	return !memcmp(&peer->addr, addr, sizeof(peer->addr));
 }
 
-bool dag_is_child(const struct child *peer, const struct in6_addr *addr)
+struct child *dag_lookup_child_or_create(struct dag *dag,
+					 const struct in6_addr *addr,
+					 const struct in6_addr *from)
 {
-	if (!peer || !addr)
-		return false;
+	struct child *peer;
 
-	return !memcmp(&peer->addr, addr, sizeof(peer->addr));
+	peer = child_table_lookup(&dag->childs, addr);
+	if (peer) {
+		/* may come via another neighbor now */
+		peer->from = *from;
+		return peer;
+	}
+
+	peer = dag_child_create(addr, from);
+	if (!peer)
+		return NULL;
+
+	if (child_table_insert(&dag->childs, peer) == -1) {
+		pool_free(&child_pool, peer);
+		return NULL;
+	}
+
+	return peer;
 }
 
-static struct child *dag_lookup_child(const struct dag *dag,
-				      const struct in6_addr *addr)
+void dag_del_child(struct dag *dag, const struct in6_addr *addr)
 {
-	struct child *peer;
-	struct list *p;
+	struct child *child;
 
-	DL_FOREACH(dag->childs.head, p) {
-		peer = container_of(p, struct child, list);
-		if (dag_is_child(peer, addr))
-			return peer;
+	child = child_table_remove(&dag->childs, addr);
+	if (!child)
+		return;
+
+	topo_del(&dag->topo, &child->topo);
+	pool_free(&child_pool, child);
+}
+
+static struct child *topo_to_child(const struct topo_node *node)
+{
+	return container_of(node, struct child, topo);
+}
+
+/*
+ * The transit parent of child is new, -1 if it would be a loop. Childs
+ * which sent their dao before this one did are adopted now.
+ */
+int dag_topo_update(struct dag *dag, struct child *child)
+{
+	struct topo_node *parent = NULL;
+	char addr_str[INET6_ADDRSTRLEN];
+	struct list *p, *tmp;
+	struct child *c;
+
+	if (!memcmp(&child->from, &dag->self, sizeof(child->from))) {
+		parent = &dag->topo.root;
+	} else {
+		c = child_table_lookup(&dag->childs, &child->from);
+		if (c)
+			parent = &c->topo;
 	}
 
-	return NULL;
+	if (topo_attach(&dag->topo, &child->topo, parent) == -1) {
+		addrtostr(&child->addr, addr_str, sizeof(addr_str));
+		flog(LOG_WARNING, "parent of %s would be a loop", addr_str);
+		return -1;
+	}
+
+	DL_FOREACH_SAFE(dag->topo.orphans.head, p, tmp) {
+		c = topo_to_child(container_of(p, struct topo_node, list));
+		if (c == child ||
+		    memcmp(&c->from, &child->addr, sizeof(c->from)))
+			continue;
+
+		topo_attach(&dag->topo, &c->topo, &child->topo);
+	}
+
+	return 0;
 }
 
-struct child *dag_lookup_child_or_create(struct dag *dag,
-					 const struct in6_addr *addr,
-					 const struct in6_addr *from)
+void dag_topo_dump(const struct dag *dag)
 {
-	struct child *peer;
+	const struct topo *t = &dag->topo;
+	char addr_str[INET6_ADDRSTRLEN];
+	const struct child *child;
+	uint16_t depth, max;
+	uint32_t i;
+
+	max = topo_max_depth(t);
+	addrtostr(&dag->dodagid, addr_str, sizeof(addr_str));
+	flog(LOG_INFO, "dag %s: %u nodes, depth %u, fan-out %u, %u hot-spots",
+	     addr_str, topo_nodes(t), max, t->root.fanout, t->hot);
+
+	for (depth = 1; depth <= max; depth++)
+		flog(LOG_INFO, "dag %s: %u nodes at depth %u%s", addr_str,
+		     t->depths[depth], depth,
+		     depth == TOPO_MAX_DEPTH ? " or more" : "");
+
+	child_table_foreach(&dag->childs, child, i) {
+		if (!child->topo.hot)
+			continue;
+
+		addrtostr(&child->addr, addr_str, sizeof(addr_str));
+		flog(LOG_INFO, "hot-spot %s: %u childs, %u nodes below%s",
+		     addr_str, child->topo.fanout, child->topo.subtree - 1,
+		     topo_is_rooted(t, &child->topo) ? "" : ", detached");
+	}
+}
 
-	peer = dag_lookup_child(dag, addr);
-	if (peer)
-		return peer;
+/*
+ * Source route of a child in non-storing mode, walks the parent graph up
+ * to us. The depth is bounded by the segments of a SRH. -1 if a parent
+ * didn't send its dao yet.
+ */
+int dag_add_srh_route(struct dag *dag, const struct child *child)
+{
+	struct in6_addr segs[NL_SRH_SEGS_MAX], tmp;
+	const struct topo_node *node = &child->topo;
+	int i, n = 0;
+
+	for (node = node->parent; node != &dag->topo.root;
+	     node = node->parent) {
+		if (!node)
+			return -1;
+
+		if (n == NL_SRH_SEGS_MAX) {
+			flog(LOG_WARNING, "source route too long");
+			return -1;
+		}
 
-	peer = dag_child_create(addr, from);
-	if (peer)
-		DL_APPEND(dag->childs.head, &peer->list);
+		segs[n++] = topo_to_child(node)->addr;
+	}
 
-	return peer;
+	/* collected bottom up, the first segment is the first hop */
+	for (i = 0; i < n / 2; i++) {
+		tmp = segs[i];
+		segs[i] = segs[n - 1 - i];
+		segs[n - 1 - i] = tmp;
+	}
+
+	return nl_add_route_srh(dag->iface->ifindex, &child->addr, segs, n,
+				NULL, NULL);
+}
+
+/* the path to child changed, so did the one of every node below it */
+void dag_add_srh_subtree(struct dag *dag, const struct child *child)
+{
+	const struct topo_node *node;
+
+	if (!topo_is_rooted(&dag->topo, &child->topo))
+		return;
+
+	topo_foreach_subtree(&child->topo, node) {
+		if (dag_add_srh_route(dag, topo_to_child(node)) == -1)
+			flog(LOG_ERR, "failed to queue source route");
+	}
 }
 
 static struct rpl *dag_lookup_rpl(const struct iface *iface,
 				  uint8_t instance_id)
 {
-	struct rpl *rpl;
-	struct list *r;
+	return iface->rpl_by_id[instance_id];
+}
 
-	DL_FOREACH(iface->rpls.head, r) {
-		rpl = container_of(r, struct rpl, list);
-		if (rpl->instance_id == instance_id)
-			return rpl;
-	}
+static struct siphash_key dag_key;
 
-	return NULL;
+/* once at startup, before the config creates the dags */
+int dag_hash_init(void)
+{
+	return siphash_key_init(&dag_key);
+}
+
+static unsigned int dag_hash(const struct in6_addr *dodagid)
+{
+	return siphash(dodagid, sizeof(*dodagid), &dag_key) &
+	       (RPL_DAG_HASH_SIZE - 1);
 }
 
 static struct dag *dag_lookup_dodag(const struct rpl *rpl,
@@ -120,8 +448,8 @@ static struct dag *dag_lookup_dodag(const struct rpl *rpl,
 	struct dag *dag;
 	struct list *d;
 
-	DL_FOREACH(rpl->dags.head, d) {
-		dag = container_of(d, struct dag, list);
+	DL_FOREACH(rpl->dag_hash[dag_hash(dodagid)].head, d) {
+		dag = container_of(d, struct dag, hash_list);
 
 		if (!memcmp(&dag->dodagid, dodagid, sizeof(dag->dodagid)))
 			return dag;
@@ -154,38 +482,210 @@ static struct rpl *dag_rpl_create(uint8_t instance_id)
 	return rpl;
 }
 
-struct dag_daoack *dag_lookup_daoack(const struct dag *dag, uint8_t dsn)
+static ev_tstamp dag_dao_rto(const struct dag *dag, uint8_t retries)
 {
-	struct dag_daoack *daoack;
-	struct list *d;
+	ev_tstamp rto = DAG_DAO_RTO_INIT;
+
+	if (dag->srtt) {
+		rto = dag->srtt + 4 * dag->rttvar;
+		if (rto < DAG_DAO_RTO_MIN)
+			rto = DAG_DAO_RTO_MIN;
+	}
 
-	DL_FOREACH(dag->pending_acks.head, d) {
-		daoack = container_of(d, struct dag_daoack, list);
+	rto *= 1 << retries;
+	if (rto > DAG_DAO_RTO_MAX)
+		rto = DAG_DAO_RTO_MAX;
 
-		if (daoack->dsn == dsn)
-			return daoack;
+	return rto;
+}
+
+/* one timer for all parts, due at the earliest retransmit */
+static void dag_dao_arm(struct dag *dag)
+{
+	const struct dag_daoack *daoack;
+	ev_tstamp expires = 0, now;
+	int i;
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		daoack = &dag->daoacks[i];
+		if (!daoack->pending || !daoack->expires)
+			continue;
+
+		if (!expires || daoack->expires < expires)
+			expires = daoack->expires;
 	}
 
-	return NULL;
+	if (!expires) {
+		wheel_timer_stop(&dag->dao_w);
+		return;
+	}
+
+	now = wheel_now();
+	wheel_timer_start(&dag->dao_w, expires > now ? expires - now : 0, 0);
+}
+
+static void dag_daoack_clear_targets(struct dag_daoack *daoack)
+{
+	free(daoack->targets);
+	daoack->targets = NULL;
+	daoack->targets_count = 0;
 }
 
-int dag_daoack_insert(struct dag *dag, uint8_t dsn)
+static void dag_daoacks_flush(struct dag *dag)
+{
+	int i;
+
+	wheel_timer_stop(&dag->dao_w);
+	for (i = 0; i <= UINT8_MAX; i++)
+		dag_daoack_clear_targets(&dag->daoacks[i]);
+
+	memset(dag->daoacks, 0, sizeof(dag->daoacks));
+}
+
+/*
+ * A dao part goes out, it takes the next dsn. The first part of a new
+ * dao has all targets again, older parts are acked but not resent.
+ */
+void dag_daoack_insert(struct dag *dag, bool first)
 {
 	struct dag_daoack *daoack;
+	ev_tstamp now = wheel_now();
+	int i;
+
+	if (first) {
+		for (i = 0; i <= UINT8_MAX; i++) {
+			dag->daoacks[i].expires = 0;
+			dag_daoack_clear_targets(&dag->daoacks[i]);
+		}
+	}
 
-	daoack = mzalloc(sizeof(*daoack));
-	if (!daoack)
+	daoack = &dag->daoacks[++dag->dsn];
+	dag_daoack_clear_targets(daoack);
+	daoack->sent = now;
+	daoack->expires = now + dag_dao_rto(dag, 0);
+	daoack->retries = 0;
+	daoack->pending = true;
+
+	dag_dao_arm(dag);
+}
+
+/* remembers the childs from first to end, they are in the part of dsn */
+static int dag_daoack_set_targets(struct dag *dag, uint8_t dsn,
+				  uint32_t first, uint32_t end)
+{
+	struct dag_daoack *daoack = &dag->daoacks[dsn];
+	uint32_t i;
+
+	dag_daoack_clear_targets(daoack);
+	if (first == end)
+		return 0;
+
+	daoack->targets = malloc((end - first) * sizeof(*daoack->targets));
+	if (!daoack->targets)
 		return -1;
 
-	DL_APPEND(dag->pending_acks.head, &daoack->list);
+	for (i = first; i < end; i++)
+		daoack->targets[i - first] = dag->childs.entries[i]->addr;
+
+	daoack->targets_count = end - first;
+	return 0;
+}
+
+/* dsn of a timed out part which should be sent again, -1 if none */
+int dag_daoack_retry(struct dag *dag)
+{
+	struct dag_daoack *daoack;
+	ev_tstamp now = wheel_now();
+	int i;
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		daoack = &dag->daoacks[i];
+		if (!daoack->pending || !daoack->expires ||
+		    daoack->expires > now)
+			continue;
+
+		if (daoack->retries == DAG_DAO_RETRIES) {
+			flog(LOG_WARNING, "no dao-ack for dsn %d, give up", i);
+			daoack->pending = false;
+			dag_daoack_clear_targets(daoack);
+			if (dag->parent)
+				neigh_tx_done(dag->parent->neigh, 0);
+
+			continue;
+		}
+
+		daoack->retries++;
+		daoack->sent = now;
+		daoack->expires = now + dag_dao_rto(dag, daoack->retries);
+		dag_dao_arm(dag);
+		return i;
+	}
+
+	dag_dao_arm(dag);
+	return -1;
+}
+
+/* -1 if there is no outstanding dao for dsn */
+int dag_daoack_process(struct dag *dag, uint8_t dsn)
+{
+	struct dag_daoack *daoack = &dag->daoacks[dsn];
+	ev_tstamp rtt, delta;
+
+	if (!daoack->pending)
+		return -1;
+
+	daoack->pending = false;
+	dag_daoack_clear_targets(daoack);
+	dag_dao_arm(dag);
+
+	if (dag->parent)
+		neigh_tx_done(dag->parent->neigh, daoack->retries + 1);
+
+	/* Karn, a retransmitted dao gives no sample */
+	if (daoack->retries)
+		return 0;
+
+	rtt = wheel_now() - daoack->sent;
+	if (!dag->srtt) {
+		dag->srtt = rtt;
+		dag->rttvar = rtt / 2;
+	} else {
+		delta = dag->srtt - rtt;
+		if (delta < 0)
+			delta = -delta;
+
+		dag->rttvar = 0.75 * dag->rttvar + 0.25 * delta;
+		dag->srtt = 0.875 * dag->srtt + 0.125 * rtt;
+	}
+
+	dlog(LOG_DEBUG, 1, "dao-ack dsn %u rtt %.3f srtt %.3f rttvar %.3f",
+	     dsn, rtt, dag->srtt, dag->rttvar);
 	return 0;
 }
 
 void dag_init_timer(struct dag *dag);
 
-static int dag_init(struct dag *dag, const struct iface *iface,
+/* Imin beyond 2^32 ms, about 49 days, makes no sense */
+#define DAG_DIO_INTERVAL_MIN_MAX	32
+
+void dag_set_trickle(struct dag *dag, uint8_t int_min, uint8_t doublings,
+		     uint8_t redundancy)
+{
+	dag->dio_int_min = int_min;
+	dag->dio_int_doublings = doublings;
+	dag->dio_redundancy = redundancy;
+
+	if (int_min > DAG_DIO_INTERVAL_MIN_MAX)
+		int_min = DAG_DIO_INTERVAL_MIN_MAX;
+
+	dag->trickle.imin = (ev_tstamp)(1ULL << int_min) / 1000;
+	dag->trickle.doublings = doublings;
+	dag->trickle.k = redundancy;
+}
+
+static int dag_init(struct dag *dag, struct iface *iface,
 		    const struct rpl *rpl, const struct in6_addr *dodagid,
-		    ev_tstamp trickle_t, uint16_t my_rank, uint8_t version,
+		    uint16_t my_rank, uint8_t version,
 		    const struct in6_prefix *dest)
 {
 	/* TODO dest is currently necessary */
@@ -201,7 +701,16 @@ static int dag_init(struct dag *dag, const struct iface *iface,
 
 	dag->version = version;
 	dag->my_rank = my_rank;
-	dag->trickle_t = DEFAULT_TICKLE_T;
+	dag->lowest_rank = RPL_INFINITE_RANK;
+	dag->min_hop_rank_inc = RPL_DEFAULT_MIN_HOP_RANK_INCREASE;
+	dag->max_rank_inc = DEFAULT_MAX_RANK_INCREASE;
+	dag->default_lifetime = DEFAULT_DEFAULT_LIFETIME;
+	dag->lifetime_unit = DEFAULT_LIFETIME_UNIT;
+	dag->of = of_lookup(RPL_OCP_OF0);
+	dag->mop = RPL_DIO_STORING_NO_MULTICAST;
+	dag_set_trickle(dag, DEFAULT_DIO_INTERVAL_MIN,
+			DEFAULT_DIO_INTERVAL_DOUBLINGS, DEFAULT_DIO_REDUNDANCY);
+	topo_init(&dag->topo);
 
 	dag_init_timer(dag);
 
@@ -209,9 +718,8 @@ static int dag_init(struct dag *dag, const struct iface *iface,
 }
 
 struct dag *dag_create(struct iface *iface, uint8_t instanceid,
-		       const struct in6_addr *dodagid, ev_tstamp trickle_t,
-		       uint16_t my_rank, uint8_t version,
-		       const struct in6_prefix *dest)
+		       const struct in6_addr *dodagid, uint16_t my_rank,
+		       uint8_t version, const struct in6_prefix *dest)
 {
 	bool append_rpl = false;
 	struct rpl *rpl;
@@ -238,79 +746,374 @@ struct dag *dag_create(struct iface *iface, uint8_t instanceid,
 		}
 	}
 
-	dag = mzalloc(sizeof(*dag));
+	dag = pool_alloc(&dag_pool);
 	if (!dag) {
 		free(rpl);
 		return NULL;
 	}
 
-	rc = dag_init(dag, iface, rpl, dodagid, trickle_t,
-		      my_rank, version, dest);
+	rc = dag_init(dag, iface, rpl, dodagid, my_rank, version, dest);
 	if (rc != 0) {
-		free(dag);
+		pool_free(&dag_pool, dag);
 		free(rpl);
 		return NULL;
 	}
 
-	if (append_rpl)
+	if (append_rpl) {
 		DL_APPEND(iface->rpls.head, &rpl->list);
+		iface->rpl_by_id[instanceid] = rpl;
+	}
 
 	DL_APPEND(rpl->dags.head, &dag->list);
+	DL_APPEND(rpl->dag_hash[dag_hash(dodagid)].head, &dag->hash_list);
 	return dag;
 }
 
 void dag_free(struct dag *dag)
 {
-	free(dag);
+	trickle_stop(&dag->trickle);
+	dag_daoacks_flush(dag);
+	wheel_timer_stop(&dag->dis_replies.w);
+	dag_flush_candidates(dag);
+	child_table_free(&dag->childs);
+	pool_free(&dag_pool, dag);
+}
+
+/* a new version is a new DODAG, nothing of the old one is valid */
+static void dag_new_version(struct dag *dag, uint8_t version)
+{
+	const struct in6_prefix any = {};
+	struct in6_prefix dst = {
+		.len = 128,
+	};
+	const struct child *child;
+	uint32_t i;
+
+	flog(LOG_INFO, "dag version %u -> %u", dag->version, version);
+
+	/* only our routes, other dags on the iface keep theirs */
+	child_table_foreach(&dag->childs, child, i) {
+		dst.prefix = child->addr;
+		if (nl_del_route(dag->iface->ifindex, &dst, NULL, NULL) == -1)
+			flog(LOG_ERR, "failed to queue route delete");
+	}
+
+	if (dag->parent &&
+	    nl_del_route(dag->iface->ifindex, &any, NULL, NULL) == -1)
+		flog(LOG_ERR, "failed to queue default route delete");
+
+	child_table_flush(&dag->childs);
+	topo_init(&dag->topo);
+
+	dag_flush_candidates(dag);
+	dag->my_rank = RPL_INFINITE_RANK;
+	dag->lowest_rank = RPL_INFINITE_RANK;
+	dag->version = version;
+
+	/* acks for daos of the old version are meaningless */
+	dag_daoacks_flush(dag);
+
+	dag_dio_invalidate(dag);
+	trickle_inconsistent(&dag->trickle);
+}
+
+static void dag_config(const struct dag *dag, struct rpl_dio_config *conf)
+{
+	memset(conf, 0, sizeof(*conf));
+	conf->rpl_dio_type = RPL_DIO_CONFIG;
+	conf->rpl_dio_len = sizeof(*conf) - 2;
+	conf->rpl_dio_int_doublings = dag->dio_int_doublings;
+	conf->rpl_dio_int_min = dag->dio_int_min;
+	conf->rpl_dio_redundancy = dag->dio_redundancy;
+	conf->rpl_dio_max_rank_inc = htons(dag->max_rank_inc);
+	conf->rpl_dio_min_hop_rank_inc = htons(dag->min_hop_rank_inc);
+	conf->rpl_dio_ocp = htons(dag->of->ocp);
+	conf->rpl_dio_def_lifetime = dag->default_lifetime;
+	conf->rpl_dio_lifetime_unit = htons(dag->lifetime_unit);
 }
 
-static int append_destprefix(const struct dag *dag, struct safe_buffer *sb)
+/*
+ * Adopt what the root configured. An unknown objective function keeps
+ * ours, we can't do better.
+ */
+void dag_process_config(struct dag *dag, const struct rpl_dio_config *conf)
 {
-	struct rpl_dio_destprefix diodp = {};
-	uint8_t len;
+	uint16_t min_hop_rank_inc = ntohs(conf->rpl_dio_min_hop_rank_inc);
+	uint16_t ocp = ntohs(conf->rpl_dio_ocp);
+	struct rpl_dio_config ours;
+	const struct of *of;
+
+	/* the same as every time, flags and reserved aren't ours */
+	dag_config(dag, &ours);
+	ours.rpl_dio_len = conf->rpl_dio_len;
+	ours.rpl_dio_flags = conf->rpl_dio_flags;
+	ours.rpl_dio_resv = conf->rpl_dio_resv;
+	if (!memcmp(&ours, conf, sizeof(ours)))
+		return;
 
-	len = sizeof(diodp) - sizeof(diodp.rpl_dio_prefix) +
-		bits_to_bytes(dag->dest.len);
+	if (conf->rpl_dio_int_min != dag->dio_int_min ||
+	    conf->rpl_dio_int_doublings != dag->dio_int_doublings ||
+	    conf->rpl_dio_redundancy != dag->dio_redundancy) {
+		flog(LOG_INFO, "trickle Imin 2^%u ms, %u doublings, k %u",
+		     conf->rpl_dio_int_min, conf->rpl_dio_int_doublings,
+		     conf->rpl_dio_redundancy);
+		dag_set_trickle(dag, conf->rpl_dio_int_min,
+				conf->rpl_dio_int_doublings,
+				conf->rpl_dio_redundancy);
+		trickle_start(&dag->trickle);
+	}
 
-	diodp.rpl_dio_type = 0x3;
-//	diodp.rpl_dio_prf = RPL_DIO_PREFIX_AUTONOMOUS_ADDR_CONFIG_FLAG;
-	/* TODO crazy calculation here */
-	diodp.rpl_dio_len = len - 2;
-	diodp.rpl_dio_prefixlen = dag->dest.len;
-	diodp.rpl_dio_prefix = dag->dest.prefix;
-	diodp.rpl_dio_route_lifetime = UINT32_MAX;
-	safe_buffer_append(sb, &diodp, len);
+	if (min_hop_rank_inc)
+		dag->min_hop_rank_inc = min_hop_rank_inc;
 
+	dag->max_rank_inc = ntohs(conf->rpl_dio_max_rank_inc);
+
+	if (ocp != dag->of->ocp) {
+		of = of_lookup(ocp);
+		if (of)
+			dag->of = of;
+		else
+			flog(LOG_WARNING, "unknown objective function %u", ocp);
+	}
+
+	dag->default_lifetime = conf->rpl_dio_def_lifetime;
+	dag->lifetime_unit = ntohs(conf->rpl_dio_lifetime_unit);
+	dag_dio_invalidate(dag);
+}
+
+/* returns false if the version is older than ours */
+bool dag_check_version(struct dag *dag, uint8_t version)
+{
+	if (version == dag->version)
+		return true;
+
+	if (!rpl_seq_greater(version, dag->version))
+		return false;
+
+	dag_new_version(dag, version);
+	return true;
+}
+
+static int append_destprefix(const struct dag *dag, struct enc *e)
+{
+	struct rpl_dio_destprefix *diodp;
+
+	diodp = enc_destprefix(e, &dag->dest);
+	if (!diodp)
+		return -1;
+
+//	diodp->rpl_dio_prf = RPL_DIO_PREFIX_AUTONOMOUS_ADDR_CONFIG_FLAG;
+	return 0;
+}
+
+static int append_lowpan_ctx(const struct dag *dag, struct enc *e)
+{
+	struct rpl_dio_lowpan_ctx *ctx;
+
+	ctx = enc_lowpan_ctx(e, &dag->dest);
+	if (!ctx)
+		return -1;
+
+	ctx->rpl_dio_flags = RPL_DIO_LOWPAN_CTX_C |
+			     (dag->ctx_cid & RPL_DIO_LOWPAN_CTX_CID_MASK);
+	ctx->rpl_dio_lifetime = htons(UINT16_MAX);
 	return 0;
 }
 
-static void dag_build_icmp(struct safe_buffer *sb, uint8_t code)
+static int append_config(const struct dag *dag, struct enc *e)
 {
-	struct icmp6_hdr nd_rpl_hdr = {
-		.icmp6_type = ND_RPL_MESSAGE,
-		.icmp6_code = code,
+	struct rpl_dio_config *conf;
+
+	conf = enc_config(e);
+	if (!conf)
+		return -1;
+
+	dag_config(dag, conf);
+	return 0;
+}
+
+/* ours, the ones of the parent with the link to it added */
+static void dag_metrics(const struct dag *dag, struct dag_metrics *mc)
+{
+	const struct peer *parent = dag->parent;
+	uint64_t latency;
+	uint32_t etx;
+
+	memset(mc, 0, sizeof(*mc));
+	mc->energy = dag->iface->energy;
+	if (dag->iface->dodag_root || !parent)
+		return;
+
+	etx = parent->mc.etx + parent->neigh->etx;
+	latency = parent->mc.latency +
+		  (uint64_t)parent->neigh->etx * dag->iface->latency /
+		  RPL_ETX_DIVISOR;
+
+	mc->hops = parent->mc.hops < UINT8_MAX ? parent->mc.hops + 1 :
+						 UINT8_MAX;
+	mc->etx = etx < UINT16_MAX ? etx : UINT16_MAX;
+	mc->latency = latency < UINT32_MAX ? latency : UINT32_MAX;
+}
+
+/* one object, the dio gets the offset of a path metric to patch it */
+static int append_mc_object(struct dag *dag, struct enc *e, uint8_t type,
+			    const struct dag_metrics *mc)
+{
+	struct rpl_mc_object *obj;
+	uint32_t latency;
+	uint16_t etx;
+
+	switch (type) {
+	case RPL_MC_HC:
+		obj = enc_mc_object(e, type, RPL_MC_HC_LEN);
+		if (!obj)
+			return -1;
+
+		/* after the flags */
+		obj->rpl_mc_data[1] = mc->hops;
+		dag->dio.hops = &obj->rpl_mc_data[1] - e->buf;
+		break;
+	case RPL_MC_LATENCY:
+		obj = enc_mc_object(e, type, RPL_MC_LATENCY_LEN);
+		if (!obj)
+			return -1;
+
+		latency = htonl(mc->latency);
+		memcpy(obj->rpl_mc_data, &latency, sizeof(latency));
+		dag->dio.latency = obj->rpl_mc_data - e->buf;
+		break;
+	case RPL_MC_ETX:
+		obj = enc_mc_object(e, type, RPL_MC_ETX_LEN);
+		if (!obj)
+			return -1;
+
+		etx = htons(mc->etx);
+		memcpy(obj->rpl_mc_data, &etx, sizeof(etx));
+		dag->dio.etx = obj->rpl_mc_data - e->buf;
+		break;
+	case RPL_MC_NE:
+		obj = enc_mc_object(e, type, RPL_MC_NE_LEN);
+		if (!obj)
+			return -1;
+
+		/* of us only, it's what a child decides by */
+		obj->rpl_mc_data[0] = mc->energy << RPL_MC_NE_T_SHIFT;
+		break;
+	default:
+		return -1;
+	}
+
+	obj->rpl_mc_aggr = RPL_MC_A_ADDITIVE << RPL_MC_A_SHIFT;
+	return 0;
+}
+
+/* RFC 6551, the metric the root optimizes for is the first object */
+static int append_metrics(struct dag *dag, struct enc *e)
+{
+	static const uint8_t types[] = {
+		RPL_MC_HC, RPL_MC_LATENCY, RPL_MC_ETX, RPL_MC_NE,
 	};
+	struct dag_metrics mc;
+	struct nd_rpl_opt *opt;
+	uint8_t type;
+	size_t i;
+
+	dag_metrics(dag, &mc);
 
-	/* TODO 4 is a hack */
-	safe_buffer_append(sb, &nd_rpl_hdr, sizeof(nd_rpl_hdr) - 4);
+	opt = enc_metrics(e);
+	if (!opt)
+		return -1;
+
+	for (i = 0; i <= sizeof(types) / sizeof(types[0]); i++) {
+		type = i ? types[i - 1] : dag->metric;
+		if (i && type == dag->metric)
+			continue;
+
+		if (append_mc_object(dag, e, type, &mc) == -1)
+			return -1;
+	}
+
+	enc_opt_close(e, opt);
+	return 0;
 }
 
-void dag_build_dio(struct dag *dag, struct safe_buffer *sb)
+static int dag_build_dio(struct dag *dag)
 {
-	struct nd_rpl_dio dio = {};
+	struct nd_rpl_dio *dio;
+	struct enc e;
 
-	dag_build_icmp(sb, ND_RPL_DAG_IO);
+	enc_init(&e, dag->dio.buf, sizeof(dag->dio.buf));
 
-	dio.rpl_instanceid = dag->rpl->instance_id;
-	dio.rpl_version = dag->version;
-	dio.rpl_dtsn = dag->dtsn++;
+	dio = enc_dio(&e);
+	if (!dio)
+		return -1;
+
+	dio->rpl_instanceid = dag->rpl->instance_id;
+	dio->rpl_version = dag->version;
 	flog(LOG_INFO, "my_rank %d", dag->my_rank);
-	dio.rpl_dagrank = htons(dag->my_rank);
-	dio.rpl_mopprf = ND_RPL_DIO_GROUNDED | RPL_DIO_STORING_NO_MULTICAST << 3;
-	dio.rpl_dagid = dag->dodagid;
+	dio->rpl_dagrank = htons(dag->my_rank);
+	dio->rpl_mopprf = ND_RPL_DIO_GROUNDED | dag->mop << RPL_DIO_MOP_SHIFT;
+	dio->rpl_dagid = dag->dodagid;
+	dag->dio.dtsn = &dio->rpl_dtsn - e.buf;
+
+	if (append_destprefix(dag, &e) == -1)
+		return -1;
+
+	/* every node passes on what the root configured */
+	if (append_config(dag, &e) == -1)
+		return -1;
 
-	safe_buffer_append(sb, &dio, sizeof(dio));
-	append_destprefix(dag, sb);
+	if (dag->metric != RPL_MC_NONE && append_metrics(dag, &e) == -1)
+		return -1;
+
+	if (dag->has_ctx && append_lowpan_ctx(dag, &e) == -1)
+		return -1;
+
+	dag->dio.len = e.len;
+	return 0;
+}
+
+/* something else than the dtsn or the path metrics changed */
+void dag_dio_invalidate(struct dag *dag)
+{
+	dag->dio.valid = false;
+}
+
+/*
+ * The dio to send, built again only after an invalidate. The path
+ * metrics follow the link estimate to the parent, they are patched
+ * like the dtsn. NULL if the dio can't be built.
+ */
+const void *dag_get_dio(struct dag *dag, size_t *len)
+{
+	struct dag_dio *dio = &dag->dio;
+	struct dag_metrics mc;
+	uint32_t latency;
+	uint16_t etx;
+
+	if (!dio->valid) {
+		if (dag_build_dio(dag) == -1) {
+			flog(LOG_ERR, "dio doesn't fit");
+			return NULL;
+		}
+
+		dio->valid = true;
+	}
+
+	dio->buf[dio->dtsn] = dag->dtsn++;
+
+	if (dag->metric != RPL_MC_NONE) {
+		dag_metrics(dag, &mc);
+		latency = htonl(mc.latency);
+		etx = htons(mc.etx);
+
+		dio->buf[dio->hops] = mc.hops;
+		memcpy(&dio->buf[dio->latency], &latency, sizeof(latency));
+		memcpy(&dio->buf[dio->etx], &etx, sizeof(etx));
+	}
+
+	*len = dio->len;
+	return dio->buf;
 }
 
 void dag_process_dio(struct dag *dag)
@@ -323,12 +1126,19 @@ void dag_process_dio(struct dag *dag)
 	if (rc == -1)
 		return;
 
-	rc = nl_add_addr(dag->iface->ifindex, &addr);
-	if (rc == -1 && errno != EEXIST) {
+	/* already done, nothing changed for the kernel */
+	if (nl_has_addr(dag->iface->ifindex, &addr)) {
+		memcpy(&dag->self, &addr, sizeof(dag->self));
+		return;
+	}
+
+	rc = nl_add_addr(dag->iface->ifindex, &addr, NULL, NULL);
+	if (rc == -1) {
 		flog(LOG_ERR, "error add nl %d", errno);
 		return;
 	}
-	rc = nl_del_route_via(dag->iface->ifindex, &dag->dest, NULL);
+	rc = nl_del_route_via(dag->iface->ifindex, &dag->dest, NULL, NULL,
+			      NULL);
 	if (rc == -1) {
 		flog(LOG_ERR, "error del nl %d, %s", errno, strerror(errno));
 		return;
@@ -337,78 +1147,173 @@ void dag_process_dio(struct dag *dag)
 	memcpy(&dag->self, &addr, sizeof(dag->self));
 }
 
-void dag_build_dao_ack(struct dag *dag, struct safe_buffer *sb)
+int dag_build_dao_ack(struct dag *dag, uint8_t dsn, struct enc *e)
 {
-	struct nd_rpl_daoack dao = {};
+	struct nd_rpl_daoack *dao;
 
-	dag_build_icmp(sb, ND_RPL_DAO_ACK);
+	dao = enc_daoack(e);
+	if (!dao)
+		return -1;
 
-	dao.rpl_instanceid = dag->rpl->instance_id;
-	dao.rpl_flags |= RPL_DAO_K_MASK;
-	dao.rpl_flags |= RPL_DAO_D_MASK;
-	dao.rpl_daoseq = dag->dsn;
-	dao.rpl_dagid = dag->dodagid;
+	dao->rpl_instanceid = dag->rpl->instance_id;
+	dao->rpl_flags |= RPL_DAOACK_D_MASK;
+	/* echo the dsn of the dao we ack */
+	dao->rpl_daoseq = dsn;
+	dao->rpl_dagid = dag->dodagid;
 
-	safe_buffer_append(sb, &dao, sizeof(dao));
 	flog(LOG_INFO, "build dao");
+	return 0;
 }
 
-static int append_target(const struct in6_prefix *prefix,
-			 struct safe_buffer *sb)
+bool dag_is_nonstoring(const struct dag *dag)
 {
-	struct rpl_dao_target target = {};
-	uint8_t len;
+	return dag->mop == RPL_DIO_NONSTORING;
+}
 
-	len = sizeof(target) - sizeof(target.rpl_dao_prefix) +
-		bits_to_bytes(prefix->len);
+/* storing mode daos go to the parent, non-storing ones to the root */
+const struct in6_addr *dag_dao_dest(const struct dag *dag)
+{
+	if (dag_is_nonstoring(dag))
+		return &dag->dodagid;
 
-	target.rpl_dao_type = RPL_DAO_RPLTARGET;
-	/* TODO crazy calculation here */
-	target.rpl_dao_len = 18;
-	target.rpl_dao_prefixlen = prefix->len;
-	target.rpl_dao_prefix = prefix->prefix;
-	safe_buffer_append(sb, &target, len);
+	return &dag->parent->addr;
+}
+
+/*
+ * Routable address of the parent for the root. The root is known by the
+ * dodagid, the others have the stateless address of the dag prefix and
+ * the interface id of their link-local address, like we do.
+ */
+static void dag_parent_global(const struct dag *dag, struct in6_addr *addr)
+{
+	if (dag->parent->rank <= dag->min_hop_rank_inc) {
+		*addr = dag->dodagid;
+		return;
+	}
+
+	memcpy(&addr->s6_addr[0], &dag->dest.prefix.s6_addr[0], 8);
+	memcpy(&addr->s6_addr[8], &dag->parent->addr.s6_addr[8], 8);
+}
+
+static int append_transit(const struct dag *dag, struct enc *e)
+{
+	struct rpl_dao_transit *transit;
+	struct in6_addr parent;
+
+	transit = enc_transit(e);
+	if (!transit)
+		return -1;
+
+	transit->rpl_dao_path_lifetime = dag->default_lifetime;
+	dag_parent_global(dag, &parent);
+	memcpy(&transit->rpl_dao_parent, &parent, sizeof(parent));
 
 	return 0;
 }
 
-void dag_build_dao(struct dag *dag, struct safe_buffer *sb)
+static int append_target(const struct in6_addr *addr, struct enc *e)
 {
-	struct nd_rpl_daoack daoack = {};
 	struct in6_prefix prefix;
+
+	prefix.prefix = *addr;
+	prefix.len = 128;
+
+	return enc_target(e, &prefix) ? 0 : -1;
+}
+
+/* header and our own target, every part has them */
+static int dag_build_dao_head(const struct dag *dag, uint8_t dsn,
+			      struct enc *e)
+{
+	struct nd_rpl_dao *dao;
+
+	dao = enc_dao(e);
+	if (!dao)
+		return -1;
+
+	dao->rpl_instanceid = dag->rpl->instance_id;
+	dao->rpl_flags |= RPL_DAO_K_MASK;
+	dao->rpl_flags |= RPL_DAO_D_MASK;
+	dao->rpl_dagid = dag->dodagid;
+
+	dao->rpl_daoseq = dsn;
+
+	return append_target(&dag->self, e);
+}
+
+/*
+ * Our targets from the child at *next on, as many as fit. *next is the
+ * child the following dao starts with, zero if all are in. The childs
+ * of the part are kept with dsn for its retransmits.
+ */
+int dag_build_dao(struct dag *dag, uint8_t dsn, struct enc *e,
+		  uint32_t *next)
+{
 	const struct child *child;
-	const struct list *c;
+	uint32_t i, first = *next;
 
-	dag_build_icmp(sb, ND_RPL_DAO);
+	if (dag_build_dao_head(dag, dsn, e) == -1)
+		return -1;
 
-	daoack.rpl_instanceid = dag->rpl->instance_id;
-	daoack.rpl_flags |= RPL_DAO_D_MASK;
-	daoack.rpl_dagid = dag->dodagid;
+	/* the root knows the rest, we have no childs */
+	if (dag_is_nonstoring(dag)) {
+		*next = 0;
+		flog(LOG_INFO, "build dao");
+		return append_transit(dag, e);
+	}
 
-	safe_buffer_append(sb, &daoack, sizeof(daoack));
-	prefix.prefix = dag->self;
-	prefix.len = 128;
-	append_target(&prefix, sb);
+	child_table_foreach(&dag->childs, child, i) {
+		if (i < first)
+			continue;
 
-	DL_FOREACH(dag->childs.head, c) {
-		child = container_of(c, struct child, list);
-		prefix.prefix = child->addr;
-		prefix.len = 128;
+		if (append_target(&child->addr, e) == -1) {
+			/* not even one more, we would never end */
+			if (i == first)
+				return -1;
 
-		append_target(&prefix, sb);
+			*next = i;
+			flog(LOG_INFO, "build dao, continued");
+			return dag_daoack_set_targets(dag, dsn, first, i);
+		}
 	}
 
-	dag_daoack_insert(dag, dag->dsn);
-	daoack.rpl_daoseq = dag->dsn++;
+	*next = 0;
 	flog(LOG_INFO, "build dao");
+	return dag_daoack_set_targets(dag, dsn, first, dag->childs.count);
 }
 
-void dag_build_dis(struct safe_buffer *sb)
+/* the part of dsn again, without the childs which are gone since */
+int dag_build_dao_part(struct dag *dag, uint8_t dsn, struct enc *e)
 {
-	struct nd_rpl_dis dis = {};
+	const struct dag_daoack *daoack = &dag->daoacks[dsn];
+	uint32_t i;
+
+	if (dag_build_dao_head(dag, dsn, e) == -1)
+		return -1;
 
-	dag_build_icmp(sb, ND_RPL_DAG_IS);
+	if (dag_is_nonstoring(dag)) {
+		flog(LOG_INFO, "build dao, again");
+		return append_transit(dag, e);
+	}
+
+	for (i = 0; i < daoack->targets_count; i++) {
+		if (!child_table_lookup(&dag->childs, &daoack->targets[i]))
+			continue;
+
+		/* it fit before, fewer fit now as well */
+		if (append_target(&daoack->targets[i], e) == -1)
+			return -1;
+	}
+
+	flog(LOG_INFO, "build dao, again");
+	return 0;
+}
+
+int dag_build_dis(struct enc *e)
+{
+	if (!enc_dis(e))
+		return -1;
 
-	safe_buffer_append(sb, &dis, sizeof(dis));
 	flog(LOG_INFO, "build dis");
+	return 0;
 }
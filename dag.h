@@ -17,27 +17,85 @@
 #include <string.h>
 #include <ev.h>
 
-#include "buffer.h"
+#include "child.h"
+#include "dis.h"
+#include "enc.h"
 #include "list.h"
+#include "neigh.h"
+#include "pool.h"
+#include "trickle.h"
+#include "wheel.h"
+
+/* RFC 6551 metrics of a dio, aggregated from the root down to its sender */
+struct dag_metrics {
+	bool present;
+	/* RPL_MC_* of the first object, the one the root optimizes for */
+	uint8_t metric;
+	uint8_t hops;
+	/* fixed point as the link etx */
+	uint16_t etx;
+	/* in microseconds */
+	uint32_t latency;
+	/* RPL_MC_NE_* of the sender only, not aggregated */
+	uint8_t energy;
+};
 
+/* candidate parent, a neighbor we got a dio from */
 struct peer {
 	struct in6_addr addr;
+	/* advertised by its dio */
 	uint16_t rank;
+	struct dag_metrics mc;
+	/* link estimate */
+	struct neigh *neigh;
 
 	struct list list;
 };
 
-struct child {
-	struct in6_addr addr;
-	struct in6_addr from;
+#define DAG_MAX_CANDIDATES	8
 
-	struct list list;
-};
+struct of;
 
+/* an outstanding dao part, the slot in the ring is the dsn */
 struct dag_daoack {
-	uint8_t dsn;
+	ev_tstamp sent;
+	/* next retransmit, zero if a newer dao replaced it */
+	ev_tstamp expires;
+	/* childs the part carries, a retransmit sends them again */
+	struct in6_addr *targets;
+	uint32_t targets_count;
+	uint8_t retries;
+	bool pending;
+};
 
-	struct list list;
+/* RFC 6298 like, in seconds */
+#define DAG_DAO_RTO_INIT	1
+#define DAG_DAO_RTO_MIN		1
+#define DAG_DAO_RTO_MAX		60
+#define DAG_DAO_RETRIES		3
+
+/* RFC 6551 container of all objects we send */
+#define DAG_MC_LEN	(sizeof(struct nd_rpl_opt) + \
+			 4 * sizeof(struct rpl_mc_object) + \
+			 RPL_MC_HC_LEN + RPL_MC_LATENCY_LEN + \
+			 RPL_MC_ETX_LEN + RPL_MC_NE_LEN)
+
+/* the largest dio we build, the prefixes are at most 16 bytes */
+#define DAG_DIO_LEN	(ENC_ICMP_LEN + sizeof(struct nd_rpl_dio) + \
+			 sizeof(struct rpl_dio_destprefix) + \
+			 sizeof(struct rpl_dio_config) + DAG_MC_LEN + \
+			 sizeof(struct rpl_dio_lowpan_ctx))
+
+/* the dio as sent, only the dtsn and the path metrics change per send */
+struct dag_dio {
+	unsigned char buf[DAG_DIO_LEN];
+	size_t len;
+	bool valid;
+	/* of the patched fields in buf, the metrics only with a container */
+	size_t dtsn;
+	size_t hops;
+	size_t latency;
+	size_t etx;
 };
 
 struct dag {
@@ -49,20 +107,49 @@ struct dag {
 	struct in6_addr dodagid;
 
 	struct in6_prefix dest;
+	/* lowpan context of dest, the root decides */
+	bool has_ctx;
+	uint8_t ctx_cid;
 
 	uint16_t my_rank;
+	/* lowest of this version, MaxRankIncrease is above it */
+	uint16_t lowest_rank;
+	uint16_t min_hop_rank_inc;
+	/* zero disables the limit */
+	uint16_t max_rank_inc;
+	const struct of *of;
+	/* mode of operation, the root decides */
+	uint8_t mop;
+	/* RPL_MC_* the root decides, none sends no metric container */
+	uint8_t metric;
+	/* the preferred parent is one of the candidates */
+	struct list_head candidates;
+	unsigned int candidates_count;
 	struct peer *parent;
 
 	/* routable self address */
 	struct in6_addr self;
-	/* routable childs, if .head NULL -> leaf */
-	struct list_head childs;
-
-	ev_tstamp trickle_t;
-	ev_timer trickle_w;
+	/* routable childs, if count is zero -> leaf */
+	struct child_table childs;
+	/* parent graph of the childs, non-storing root only */
+	struct topo topo;
+
+	/* RFC 6550 units, Imin is 2^dio_int_min ms */
+	uint8_t dio_int_min;
+	uint8_t dio_int_doublings;
+	uint8_t dio_redundancy;
+	struct trickle trickle;
+	/* unicast dios for the dis which solicited us */
+	struct dis_replies dis_replies;
+	/* built on the first send after dag_dio_invalidate() */
+	struct dag_dio dio;
+
+	/* of routes, default_lifetime in lifetime_unit seconds */
+	uint8_t default_lifetime;
+	uint16_t lifetime_unit;
 
 	/* iface which dag belongs to */
-	const struct iface *iface;
+	struct iface *iface;
 	/* rpl instance which dag belongs to */
 	const struct rpl *rpl;
 
@@ -71,36 +158,69 @@ struct dag {
 	 * No idea how it works when it's not given. We don't
 	 * support it.
 	 */
-	struct list_head pending_acks;
+	struct dag_daoack daoacks[UINT8_MAX + 1];
+	/* retransmits unacked dao parts, armed for the earliest */
+	struct wheel_timer dao_w;
+	/* dao to dao-ack round trip, zero until the first sample */
+	ev_tstamp srtt;
+	ev_tstamp rttvar;
 
 	struct list list;
+	struct list hash_list;
 };
 
+/* must be a power of two */
+#define RPL_DAG_HASH_SIZE	16
+
 struct rpl {
 	uint8_t instance_id;
 
 	/* set of dags, unique key is dodagid */
 	struct list_head dags;
+	/* same dags hashed by dodagid for lookup */
+	struct list_head dag_hash[RPL_DAG_HASH_SIZE];
 
 	struct list list;
 };
 
+extern struct pool dag_pool;
+extern struct pool peer_pool;
+
+int dag_hash_init(void);
 struct dag *dag_create(struct iface *iface, uint8_t instanceid,
-		       const struct in6_addr *dodagid, ev_tstamp trickle_t,
-		       uint16_t my_rank, uint8_t version,
-		       const struct in6_prefix *dest);
+		       const struct in6_addr *dodagid, uint16_t my_rank,
+		       uint8_t version, const struct in6_prefix *dest);
 void dag_free(struct dag *dag);
-void dag_build_dio(struct dag *dag, struct safe_buffer *sb);
+void dag_set_trickle(struct dag *dag, uint8_t int_min, uint8_t doublings,
+		     uint8_t redundancy);
+void dag_dio_invalidate(struct dag *dag);
+const void *dag_get_dio(struct dag *dag, size_t *len);
 struct dag *dag_lookup(const struct iface *iface, uint8_t instance_id,
 		       const struct in6_addr *dodagid);
 void dag_process_dio(struct dag *dag);
-struct peer *dag_peer_create(const struct in6_addr *addr);
-void dag_build_dao(struct dag *dag, struct safe_buffer *sb);
-void dag_build_dao_ack(struct dag *dag, struct safe_buffer *sb);
-void dag_build_dis(struct safe_buffer *sb);
+bool dag_check_version(struct dag *dag, uint8_t version);
+void dag_process_config(struct dag *dag, const struct rpl_dio_config *conf);
+int dag_update_candidate(struct dag *dag, const struct in6_addr *addr,
+			 uint16_t rank, const struct dag_metrics *mc);
+bool dag_select_parent(struct dag *dag);
+bool dag_is_nonstoring(const struct dag *dag);
+const struct in6_addr *dag_dao_dest(const struct dag *dag);
+int dag_build_dao(struct dag *dag, uint8_t dsn, struct enc *e,
+		  uint32_t *next);
+int dag_build_dao_part(struct dag *dag, uint8_t dsn, struct enc *e);
+int dag_build_dao_ack(struct dag *dag, uint8_t dsn, struct enc *e);
+void dag_daoack_insert(struct dag *dag, bool first);
+int dag_daoack_retry(struct dag *dag);
+int dag_daoack_process(struct dag *dag, uint8_t dsn);
+int dag_build_dis(struct enc *e);
 struct child *dag_lookup_child_or_create(struct dag *dag,
 					 const struct in6_addr *addr,
 					 const struct in6_addr *from);
+void dag_del_child(struct dag *dag, const struct in6_addr *addr);
+int dag_topo_update(struct dag *dag, struct child *child);
+void dag_topo_dump(const struct dag *dag);
+int dag_add_srh_route(struct dag *dag, const struct child *child);
+void dag_add_srh_subtree(struct dag *dag, const struct child *child);
 bool dag_is_peer(const struct peer *peer, const struct in6_addr *addr);
 
 #endif /* __RPLD_DAG_H__ */
@@ -0,0 +1,88 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <string.h>
+
+#include "neigh.h"
+#include "dis.h"
+
+/* every sender we don't know as neighbor shares this one */
+static struct dis_bucket unknown;
+
+static bool dis_take(struct dis_bucket *b, double rate, double burst)
+{
+	ev_tstamp now = wheel_now();
+
+	if (!b->used) {
+		b->used = true;
+		b->tokens = burst;
+	} else {
+		b->tokens += (now - b->updated) * rate;
+		if (b->tokens > burst)
+			b->tokens = burst;
+	}
+	b->updated = now;
+
+	if (b->tokens < 1)
+		return false;
+
+	b->tokens--;
+	return true;
+}
+
+/* false if the sender is over its rate. A spoofed source can't drain
+ * the bucket of a neighbor, only the shared one.
+ */
+bool dis_allow(uint32_t ifindex, const struct in6_addr *addr)
+{
+	struct neigh *neigh = neigh_lookup(ifindex, addr);
+
+	if (neigh)
+		return dis_take(&neigh->dis, DIS_RATE, DIS_BURST);
+
+	return dis_take(&unknown, DIS_UNKNOWN_RATE, DIS_UNKNOWN_BURST);
+}
+
+void dis_replies_init(struct dis_replies *r, wheel_cb_t cb)
+{
+	dis_replies_reset(r);
+	wheel_timer_init(&r->w, cb);
+}
+
+/* the window starts with the first dis, more don't delay it */
+void dis_replies_queue(struct dis_replies *r, const struct in6_addr *to)
+{
+	unsigned int i;
+
+	if (!r->multicast) {
+		for (i = 0; i < r->count; i++) {
+			if (!memcmp(&r->to[i], to, sizeof(*to)))
+				break;
+		}
+
+		if (i == r->count) {
+			if (r->count == DIS_REPLY_MAX)
+				r->multicast = true;
+			else
+				r->to[r->count++] = *to;
+		}
+	}
+
+	if (!wheel_timer_pending(&r->w))
+		wheel_timer_start(&r->w, DIS_REPLY_DELAY, 0);
+}
+
+void dis_replies_reset(struct dis_replies *r)
+{
+	r->count = 0;
+	r->multicast = false;
+}
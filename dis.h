@@ -0,0 +1,54 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_DIS_H__
+#define __RPLD_DIS_H__
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wheel.h"
+
+/* seconds unicast dis are collected before the dios go out */
+#define DIS_REPLY_DELAY		0.25
+/* unicast dios per window, more senders get one multicast dio */
+#define DIS_REPLY_MAX		4
+/* token bucket per neighbor, tokens per second and depth */
+#define DIS_RATE		0.2
+#define DIS_BURST		4
+/* one bucket for all senders which are no neighbor yet */
+#define DIS_UNKNOWN_RATE	1
+#define DIS_UNKNOWN_BURST	8
+
+struct dis_bucket {
+	ev_tstamp updated;
+	double tokens;
+	bool used;
+};
+
+/* dios owed to unicast dis senders of a dag */
+struct dis_replies {
+	struct in6_addr to[DIS_REPLY_MAX];
+	unsigned int count;
+	/* too many, one multicast dio answers all */
+	bool multicast;
+
+	struct wheel_timer w;
+};
+
+bool dis_allow(uint32_t ifindex, const struct in6_addr *addr);
+void dis_replies_init(struct dis_replies *r, wheel_cb_t cb);
+void dis_replies_queue(struct dis_replies *r, const struct in6_addr *to);
+void dis_replies_reset(struct dis_replies *r);
+
+#endif /* __RPLD_DIS_H__ */
@@ -0,0 +1,178 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <string.h>
+
+#include "enc.h"
+
+void enc_init(struct enc *e, void *buf, size_t size)
+{
+	e->buf = buf;
+	e->size = size;
+	e->len = 0;
+}
+
+/* len zeroed bytes at the end, NULL if they don't fit */
+void *enc_put(struct enc *e, size_t len)
+{
+	void *p;
+
+	if (len > e->size - e->len)
+		return NULL;
+
+	p = &e->buf[e->len];
+	memset(p, 0, len);
+	e->len += len;
+
+	return p;
+}
+
+/* an option of len bytes with type and length already set */
+static void *enc_opt(struct enc *e, uint8_t type, size_t len)
+{
+	struct nd_rpl_opt *opt;
+
+	opt = enc_put(e, len);
+	if (!opt)
+		return NULL;
+
+	opt->type = type;
+	opt->len = len - sizeof(*opt);
+
+	return opt;
+}
+
+/* the length of an option which grew after it was started */
+void enc_opt_close(struct enc *e, struct nd_rpl_opt *opt)
+{
+	opt->len = &e->buf[e->len] - (unsigned char *)opt - sizeof(*opt);
+}
+
+/* the icmpv6 header and the message base of len bytes after it */
+static void *enc_msg(struct enc *e, uint8_t code, size_t len)
+{
+	struct icmp6_hdr *hdr;
+
+	if (ENC_ICMP_LEN + len > e->size - e->len)
+		return NULL;
+
+	/* the kernel does the checksum */
+	hdr = enc_put(e, ENC_ICMP_LEN);
+	hdr->icmp6_type = ND_RPL_MESSAGE;
+	hdr->icmp6_code = code;
+
+	return enc_put(e, len);
+}
+
+struct nd_rpl_dio *enc_dio(struct enc *e)
+{
+	return enc_msg(e, ND_RPL_DAG_IO, sizeof(struct nd_rpl_dio));
+}
+
+struct nd_rpl_dao *enc_dao(struct enc *e)
+{
+	return enc_msg(e, ND_RPL_DAO, sizeof(struct nd_rpl_dao));
+}
+
+struct nd_rpl_daoack *enc_daoack(struct enc *e)
+{
+	return enc_msg(e, ND_RPL_DAO_ACK, sizeof(struct nd_rpl_daoack));
+}
+
+struct nd_rpl_dis *enc_dis(struct enc *e)
+{
+	return enc_msg(e, ND_RPL_DAG_IS, sizeof(struct nd_rpl_dis));
+}
+
+/* only the bytes of the prefix are sent, the route lifetime is infinite */
+struct rpl_dio_destprefix *enc_destprefix(struct enc *e,
+					  const struct in6_prefix *prefix)
+{
+	struct rpl_dio_destprefix *diodp;
+	uint8_t n = bits_to_bytes(prefix->len);
+
+	diodp = enc_opt(e, RPL_DIO_ROUTINGINFO,
+			offsetof(struct rpl_dio_destprefix, rpl_dio_prefix) + n);
+	if (!diodp)
+		return NULL;
+
+	diodp->rpl_dio_prefixlen = prefix->len;
+	diodp->rpl_dio_route_lifetime = RPL_DIO_LIFETIME_INFINITE;
+	memcpy(&diodp->rpl_dio_prefix, &prefix->prefix, n);
+
+	return diodp;
+}
+
+struct rpl_dio_config *enc_config(struct enc *e)
+{
+	return enc_opt(e, RPL_DIO_CONFIG, sizeof(struct rpl_dio_config));
+}
+
+/* the objects follow, enc_opt_close() when they are in */
+struct nd_rpl_opt *enc_metrics(struct enc *e)
+{
+	return enc_opt(e, RPL_DIO_METRICS, sizeof(struct nd_rpl_opt));
+}
+
+struct rpl_mc_object *enc_mc_object(struct enc *e, uint8_t type,
+				    uint8_t len)
+{
+	struct rpl_mc_object *obj;
+
+	obj = enc_put(e, sizeof(*obj) + len);
+	if (!obj)
+		return NULL;
+
+	obj->rpl_mc_type = type;
+	obj->rpl_mc_len = len;
+
+	return obj;
+}
+
+struct rpl_dio_lowpan_ctx *enc_lowpan_ctx(struct enc *e,
+					  const struct in6_prefix *prefix)
+{
+	struct rpl_dio_lowpan_ctx *ctx;
+	uint8_t n = bits_to_bytes(prefix->len);
+
+	ctx = enc_opt(e, RPL_DIO_LOWPAN_CTX,
+		      offsetof(struct rpl_dio_lowpan_ctx, rpl_dio_prefix) + n);
+	if (!ctx)
+		return NULL;
+
+	ctx->rpl_dio_ctxlen = prefix->len;
+	memcpy(&ctx->rpl_dio_prefix, &prefix->prefix, n);
+
+	return ctx;
+}
+
+struct rpl_dao_target *enc_target(struct enc *e,
+				  const struct in6_prefix *prefix)
+{
+	struct rpl_dao_target *target;
+	uint8_t n = bits_to_bytes(prefix->len);
+
+	target = enc_opt(e, RPL_DAO_RPLTARGET,
+			 offsetof(struct rpl_dao_target, rpl_dao_prefix) + n);
+	if (!target)
+		return NULL;
+
+	target->rpl_dao_prefixlen = prefix->len;
+	memcpy(&target->rpl_dao_prefix, &prefix->prefix, n);
+
+	return target;
+}
+
+struct rpl_dao_transit *enc_transit(struct enc *e)
+{
+	return enc_opt(e, RPL_DAO_TRANSITINFO, sizeof(struct rpl_dao_transit));
+}
@@ -0,0 +1,61 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_ENC_H__
+#define __RPLD_ENC_H__
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip6.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "helpers.h"
+#include "rpl.h"
+
+/* icmpv6 payload of a packet of the IPv6 minimum MTU, RFC 8200 5 */
+#define ENC_MTU		(1280 - sizeof(struct ip6_hdr))
+
+/* the rpl message starts where the icmpv6 data does, RFC 6550 6 */
+#define ENC_ICMP_LEN	offsetof(struct icmp6_hdr, icmp6_dataun)
+
+/* a message is written into a buffer of the caller, nothing grows */
+struct enc {
+	unsigned char *buf;
+	size_t size;
+	size_t len;
+};
+
+void enc_init(struct enc *e, void *buf, size_t size);
+void *enc_put(struct enc *e, size_t len);
+void enc_opt_close(struct enc *e, struct nd_rpl_opt *opt);
+
+/* the typed ones return NULL if it doesn't fit, nothing is written then */
+struct nd_rpl_dio *enc_dio(struct enc *e);
+struct nd_rpl_dao *enc_dao(struct enc *e);
+struct nd_rpl_daoack *enc_daoack(struct enc *e);
+struct nd_rpl_dis *enc_dis(struct enc *e);
+
+struct rpl_dio_destprefix *enc_destprefix(struct enc *e,
+					  const struct in6_prefix *prefix);
+struct rpl_dio_config *enc_config(struct enc *e);
+struct nd_rpl_opt *enc_metrics(struct enc *e);
+struct rpl_mc_object *enc_mc_object(struct enc *e, uint8_t type,
+				    uint8_t len);
+struct rpl_dio_lowpan_ctx *enc_lowpan_ctx(struct enc *e,
+					  const struct in6_prefix *prefix);
+struct rpl_dao_target *enc_target(struct enc *e,
+				  const struct in6_prefix *prefix);
+struct rpl_dao_transit *enc_transit(struct enc *e);
+
+#endif /* __RPLD_ENC_H__ */
@@ -140,3 +140,28 @@ int gen_random_private_ula_pfx(struct in6_prefix *prefix)
 
 	return 0;
 }
+
+/* RFC 6550 7.2, lollipop counters for versions, DTSN and DSN */
+bool rpl_seq_greater(uint8_t a, uint8_t b)
+{
+	uint8_t d;
+
+	/* one in the linear, one in the circular region */
+	if (a > 127 && b <= 127)
+		return (256 + b - a) > RPL_SEQUENCE_WINDOW;
+	if (a <= 127 && b > 127)
+		return (256 + a - b) <= RPL_SEQUENCE_WINDOW;
+
+	/* both linear */
+	if (a > 127)
+		return a > b;
+
+	/* both circular, out of window is a resync and counts as newer */
+	d = (a - b) & 0x7f;
+	if (!d)
+		return false;
+	if (128 - d <= RPL_SEQUENCE_WINDOW)
+		return false;
+
+	return true;
+}
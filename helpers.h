@@ -20,6 +20,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -57,6 +58,23 @@ struct in6_prefix {
 	uint8_t len;
 };
 
+static inline bool in6_prefix_contains(const struct in6_prefix *pfx,
+				       const struct in6_addr *addr)
+{
+	uint8_t bytes = pfx->len >> 3;
+	uint8_t bits = pfx->len & 0x7;
+	uint8_t mask;
+
+	if (memcmp(&pfx->prefix, addr, bytes))
+		return false;
+
+	if (!bits)
+		return true;
+
+	mask = 0xff << (8 - bits);
+	return !((pfx->prefix.s6_addr[bytes] ^ addr->s6_addr[bytes]) & mask);
+}
+
 struct iface_llinfo;
 int gen_stateless_addr(const struct in6_prefix *prefix,
 		       const struct iface_llinfo *llinfo,
@@ -69,6 +87,9 @@ int set_var(const char *var, uint32_t val);
 void init_random_gen(void);
 int gen_random_private_ula_pfx(struct in6_prefix *prefix);
 
+#define RPL_SEQUENCE_WINDOW	16
+bool rpl_seq_greater(uint8_t a, uint8_t b);
+
 #undef offsetof
 #define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
 
@@ -0,0 +1,162 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "lowpan.h"
+#include "config.h"
+#include "log.h"
+
+/*
+ * The kernel 6LoWPAN context table is only exposed by debugfs:
+ *
+ * /sys/kernel/debug/6lowpan/<ifname>/contexts/<cid>/{active,prefix,compression}
+ *
+ * prefix wants all eight groups and the prefix length, e.g.
+ * fd3c:be8a:173f:8e80:0000:0000:0000:0000/64.
+ */
+static int lowpan_ctx_write(const struct iface *iface, uint8_t cid,
+			    const char *name, const char *val)
+{
+	char path[PATH_MAX];
+	int retval = -1;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), LOWPAN_DEBUGFS_CTX, iface->ifname, cid,
+		 name);
+
+	/* no debugfs or not a lowpan interface */
+	if (access(path, F_OK) != 0) {
+		dlog(LOG_DEBUG, 3, "%s not available", path);
+		return -1;
+	}
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		flog(LOG_ERR, "failed to open %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	if (fprintf(fp, "%s", val) < 0)
+		flog(LOG_ERR, "failed to set %s: %s", path, strerror(errno));
+	else
+		retval = 0;
+
+	/* the kernel parses it on write back */
+	if (fclose(fp) == EOF) {
+		flog(LOG_ERR, "failed to set %s: %s", path, strerror(errno));
+		retval = -1;
+	}
+
+	return retval;
+}
+
+int lowpan_ctx_set(struct iface *iface, uint8_t cid,
+		   const struct in6_prefix *pfx, bool compression)
+{
+	const uint8_t *a = pfx->prefix.s6_addr;
+	struct lowpan_ctx *ctx;
+	char buf[64];
+	int rc;
+
+	if (cid >= LOWPAN_CTX_MAX || pfx->len > 128)
+		return -1;
+
+	ctx = &iface->ctxs[cid];
+
+	/* nothing changed */
+	if (ctx->active && ctx->compression == compression &&
+	    ctx->pfx.len == pfx->len &&
+	    !memcmp(&ctx->pfx.prefix, &pfx->prefix, sizeof(pfx->prefix)))
+		return 0;
+
+	snprintf(buf, sizeof(buf),
+		 "%02x%02x:%02x%02x:%02x%02x:%02x%02x:"
+		 "%02x%02x:%02x%02x:%02x%02x:%02x%02x/%u",
+		 a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9],
+		 a[10], a[11], a[12], a[13], a[14], a[15], pfx->len);
+
+	rc = lowpan_ctx_write(iface, cid, "prefix", buf);
+	if (rc == -1)
+		return -1;
+
+	rc = lowpan_ctx_write(iface, cid, "compression",
+			      compression ? "1" : "0");
+	if (rc == -1)
+		return -1;
+
+	rc = lowpan_ctx_write(iface, cid, "active", "1");
+	if (rc == -1)
+		return -1;
+
+	ctx->pfx = *pfx;
+	ctx->compression = compression;
+	ctx->active = true;
+
+	flog(LOG_INFO, "%s context %u: %s", iface->ifname, cid, buf);
+	return 0;
+}
+
+/* returns the context id for pfx, the same if it is already there */
+int lowpan_ctx_alloc(struct iface *iface, const struct in6_prefix *pfx)
+{
+	int i, cid = -1;
+
+	for (i = 0; i < LOWPAN_CTX_MAX; i++) {
+		if (!iface->ctxs[i].active) {
+			if (cid == -1)
+				cid = i;
+			continue;
+		}
+
+		if (iface->ctxs[i].pfx.len == pfx->len &&
+		    !memcmp(&iface->ctxs[i].pfx.prefix, &pfx->prefix,
+			    sizeof(pfx->prefix)))
+			return i;
+	}
+
+	if (cid == -1) {
+		flog(LOG_WARNING, "%s has no free lowpan context",
+		     iface->ifname);
+		return -1;
+	}
+
+	if (lowpan_ctx_set(iface, cid, pfx, true) == -1)
+		return -1;
+
+	return cid;
+}
+
+void lowpan_ctx_clear(struct iface *iface, uint8_t cid)
+{
+	if (cid >= LOWPAN_CTX_MAX || !iface->ctxs[cid].active)
+		return;
+
+	lowpan_ctx_write(iface, cid, "active", "0");
+	iface->ctxs[cid].active = false;
+	flog(LOG_INFO, "%s context %u: inactive", iface->ifname, cid);
+}
+
+void lowpan_ctx_flush(struct iface *iface)
+{
+	int i;
+
+	for (i = 0; i < LOWPAN_CTX_MAX; i++) {
+		if (!iface->ctxs[i].active)
+			continue;
+
+		lowpan_ctx_write(iface, i, "active", "0");
+		iface->ctxs[i].active = false;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_LOWPAN_H__
+#define __RPLD_LOWPAN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "helpers.h"
+
+/* RFC 6282, 4 bit context identifier */
+#define LOWPAN_CTX_MAX		16
+#define LOWPAN_DEBUGFS_CTX	"/sys/kernel/debug/6lowpan/%s/contexts/%u/%s"
+
+struct lowpan_ctx {
+	struct in6_prefix pfx;
+	bool compression;
+	bool active;
+};
+
+struct iface;
+
+int lowpan_ctx_alloc(struct iface *iface, const struct in6_prefix *pfx);
+int lowpan_ctx_set(struct iface *iface, uint8_t cid,
+		   const struct in6_prefix *pfx, bool compression);
+void lowpan_ctx_clear(struct iface *iface, uint8_t cid);
+void lowpan_ctx_flush(struct iface *iface);
+
+#endif /* __RPLD_LOWPAN_H__ */
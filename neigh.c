@@ -0,0 +1,190 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <linux/neighbour.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "netlink.h"
+#include "wheel.h"
+#include "neigh.h"
+#include "of.h"
+
+/* weight of the old estimate in quarters */
+#define NEIGH_ETX_ALPHA		3
+
+struct pool neigh_pool = POOL_INIT("neigh", struct neigh);
+
+/* only neighbors which are candidate parents somewhere, a few */
+static struct list_head neighs;
+
+static struct wheel_timer probe_w;
+static neigh_probe_cb_t probe_cb;
+static void *probe_cb_data;
+
+struct neigh *neigh_lookup(uint32_t ifindex, const struct in6_addr *addr)
+{
+	struct neigh *neigh;
+	struct list *n;
+
+	DL_FOREACH(neighs.head, n) {
+		neigh = container_of(n, struct neigh, list);
+
+		if (neigh->ifindex == ifindex &&
+		    !memcmp(&neigh->addr, addr, sizeof(neigh->addr)))
+			return neigh;
+	}
+
+	return NULL;
+}
+
+struct neigh *neigh_get(uint32_t ifindex, const struct in6_addr *addr)
+{
+	struct neigh *neigh;
+
+	neigh = neigh_lookup(ifindex, addr);
+	if (neigh) {
+		neigh->refcnt++;
+		return neigh;
+	}
+
+	neigh = pool_alloc(&neigh_pool);
+	if (!neigh)
+		return NULL;
+
+	neigh->ifindex = ifindex;
+	neigh->addr = *addr;
+	neigh->etx = RPL_ETX_INIT;
+	neigh->refcnt = 1;
+	DL_APPEND(neighs.head, &neigh->list);
+
+	return neigh;
+}
+
+void neigh_put(struct neigh *neigh)
+{
+	if (!neigh || --neigh->refcnt)
+		return;
+
+	DL_DELETE(neighs.head, &neigh->list);
+	pool_free(&neigh_pool, neigh);
+}
+
+/* a unicast to neigh needed tx transmissions, zero if it never got through */
+void neigh_tx_done(struct neigh *neigh, unsigned int tx)
+{
+	uint32_t sample;
+
+	neigh->tx++;
+	if (!tx) {
+		neigh->tx_failed++;
+		tx = NEIGH_ETX_NOACK_PENALTY;
+	}
+
+	sample = tx * RPL_ETX_DIVISOR;
+	neigh->etx = (NEIGH_ETX_ALPHA * neigh->etx + sample) /
+		     (NEIGH_ETX_ALPHA + 1);
+	neigh->updated = wheel_now();
+}
+
+/* any dio of a probed neighbor answers the probe */
+void neigh_rx_dio(uint32_t ifindex, const struct in6_addr *addr)
+{
+	struct neigh *neigh;
+
+	neigh = neigh_lookup(ifindex, addr);
+	if (!neigh || !neigh->probe_pending)
+		return;
+
+	neigh->probe_pending = false;
+	neigh_tx_done(neigh, 1);
+}
+
+static void neigh_nud_cb(uint32_t ifindex, const struct in6_addr *addr,
+			 uint16_t state, void *data)
+{
+	struct neigh *neigh;
+
+	neigh = neigh_lookup(ifindex, addr);
+	if (!neigh)
+		return;
+
+	/* the kernel confirmed the link or gave up on it */
+	if (state & NUD_REACHABLE)
+		neigh_tx_done(neigh, 1);
+	else if (state & NUD_FAILED)
+		neigh_tx_done(neigh, 0);
+}
+
+static void neigh_probe_cb(struct wheel_timer *w)
+{
+	ev_tstamp now = wheel_now();
+	unsigned int probes = 0;
+	struct neigh *neigh;
+	struct list *n;
+
+	DL_FOREACH(neighs.head, n) {
+		neigh = container_of(n, struct neigh, list);
+
+		if (neigh->probe_pending) {
+			neigh->probe_pending = false;
+			neigh_tx_done(neigh, 0);
+			continue;
+		}
+
+		if (now - neigh->updated < NEIGH_FRESHNESS ||
+		    probes == NEIGH_PROBE_BURST)
+			continue;
+
+		neigh->probe_pending = true;
+		neigh->probe_sent = now;
+		probes++;
+		probe_cb(neigh, probe_cb_data);
+	}
+}
+
+void neigh_dump(void)
+{
+	char addr_str[INET6_ADDRSTRLEN];
+	ev_tstamp now = wheel_now();
+	struct neigh *neigh;
+	struct list *n;
+
+	DL_FOREACH(neighs.head, n) {
+		neigh = container_of(n, struct neigh, list);
+
+		addrtostr(&neigh->addr, addr_str, sizeof(addr_str));
+		flog(LOG_INFO, "neigh %s: etx %u.%02u, age %.0f s, %u/%u failed",
+		     addr_str, neigh->etx / RPL_ETX_DIVISOR,
+		     (neigh->etx % RPL_ETX_DIVISOR) * 100 / RPL_ETX_DIVISOR,
+		     neigh->updated ? now - neigh->updated : -1,
+		     neigh->tx_failed, neigh->tx);
+	}
+}
+
+void neigh_open(neigh_probe_cb_t cb, void *data)
+{
+	probe_cb = cb;
+	probe_cb_data = data;
+
+	nl_neighs_monitor(neigh_nud_cb, NULL);
+
+	wheel_timer_init(&probe_w, neigh_probe_cb);
+	wheel_timer_start(&probe_w, NEIGH_PROBE_INTERVAL,
+			  NEIGH_PROBE_INTERVAL);
+}
+
+void neigh_close(void)
+{
+	wheel_timer_stop(&probe_w);
+	nl_neighs_monitor(NULL, NULL);
+}
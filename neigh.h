@@ -0,0 +1,71 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_NEIGH_H__
+#define __RPLD_NEIGH_H__
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+#include "dis.h"
+#include "list.h"
+#include "pool.h"
+
+/* a sample without getting through counts as that many transmissions */
+#define NEIGH_ETX_NOACK_PENALTY	10
+/* seconds without a sample until the link is probed */
+#define NEIGH_FRESHNESS		120
+/* seconds between probe rounds, an unanswered probe failed after one */
+#define NEIGH_PROBE_INTERVAL	15
+/* probes per round at most */
+#define NEIGH_PROBE_BURST	4
+
+/*
+ * Link estimate of a neighbor, refcounted by the candidate parents which
+ * use it. ETX is an EWMA of the transmissions a unicast needed, fixed
+ * point RPL_ETX_DIVISOR.
+ */
+struct neigh {
+	uint32_t ifindex;
+	struct in6_addr addr;
+
+	uint16_t etx;
+	/* time of the last sample, zero if there was none */
+	ev_tstamp updated;
+	ev_tstamp probe_sent;
+	bool probe_pending;
+
+	unsigned int tx;
+	unsigned int tx_failed;
+	/* rate limit of its dis */
+	struct dis_bucket dis;
+
+	unsigned int refcnt;
+	struct list list;
+};
+
+typedef void (*neigh_probe_cb_t)(const struct neigh *neigh, void *data);
+
+extern struct pool neigh_pool;
+
+struct neigh *neigh_get(uint32_t ifindex, const struct in6_addr *addr);
+void neigh_put(struct neigh *neigh);
+struct neigh *neigh_lookup(uint32_t ifindex, const struct in6_addr *addr);
+void neigh_tx_done(struct neigh *neigh, unsigned int tx);
+void neigh_rx_dio(uint32_t ifindex, const struct in6_addr *addr);
+void neigh_dump(void);
+void neigh_open(neigh_probe_cb_t cb, void *data);
+void neigh_close(void);
+
+#endif /* __RPLD_NEIGH_H__ */
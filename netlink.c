@@ -10,63 +10,2012 @@
  *   may request it from <alex.aring@gmail.com>.
  */
 
-#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include <libmnl/libmnl.h>
+#include <linux/fib_rules.h>
+#include <linux/neighbour.h>
 #include <linux/rtnetlink.h>
 
+#ifdef HAVE_LINUX_NEXTHOP_H
+#include <linux/nexthop.h>
+#else
+/* uapi of kernels >= 5.3, for older kernel headers */
+#ifndef RTM_NEWNEXTHOP
+#define RTM_NEWNEXTHOP	104
+#define RTM_DELNEXTHOP	105
+#define RTM_GETNEXTHOP	106
+#endif
+#define RTA_NH_ID	30
+
+struct nhmsg {
+	unsigned char nh_family;
+	unsigned char nh_scope;
+	unsigned char nh_protocol;
+	unsigned char resvd;
+	unsigned int nh_flags;
+};
+
+enum {
+	NHA_UNSPEC,
+	NHA_ID,
+	NHA_GROUP,
+	NHA_GROUP_TYPE,
+	NHA_BLACKHOLE,
+	NHA_OIF,
+	NHA_GATEWAY,
+};
+#endif
+
+#ifdef HAVE_LINUX_RPL_IPTUNNEL_H
+#include <linux/lwtunnel.h>
+#include <linux/rpl_iptunnel.h>
+#else
+/* uapi of kernels >= 5.9 */
+#define LWTUNNEL_ENCAP_RPL	8
+#define RPL_IPTUNNEL_SRH	1
+#endif
+
+/* type 3 routing header, RFC 6554 */
+#define NL_SRH_TYPE	3
+#define NL_SRH_HDR_LEN	8
+
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK	12
+#endif
+
 #include "netlink.h"
 #include "log.h"
 
-static struct mnl_socket *nl;
-static unsigned int portid;
+/* libmnl wants the batch buffer twice as large as the limit, the message
+ * which overflows the limit is moved to the head of the next batch.
+ */
+#define NL_BATCH_LIMIT	MNL_SOCKET_BUFFER_SIZE
+/* maximum of requests in flight, must be a power of two */
+#define NL_REQS_MAX	1024
+#define NL_RCVBUF_SIZE	(1024 * 1024)
+#define NL_SYNC_TIMEOUT_MS	5000
+/* must be a power of two */
+#define NL_MIRROR_BUCKETS	256
+/* ids of our nexthop objects start here, should not collide with others */
+#define NL_NH_ID_BASE	0x72706c00
+/* before the main table, our routes are more specific than the
+ * kernel prefix route. Our default route is suppressed there, else it
+ * would catch everything main routes, e.g. link-local to the childs.
+ */
+#define NL_RULE_PRIO	1000
+/* our default route after main and default, only if they have none */
+#define NL_RULE_PRIO_DEFAULT	40000
+/* older headers don't know the nexthop id */
+#define NL_RTA_MAX	(RTA_MAX > RTA_NH_ID ? RTA_MAX : RTA_NH_ID)
+
+/* identifies an address or route which was installed by us */
+struct nl_key {
+	uint16_t type;
+	uint32_t ifindex;
+	struct in6_prefix dst;
+	struct in6_addr via;
+	/* source routes, hash of the segments */
+	uint64_t segs;
+};
+
+struct nl_req {
+	uint32_t seq;
+	uint16_t type;
+	bool pending;
+
+	/* replies which are not an ack, e.g. RTM_NEWLINK on RTM_GETLINK */
+	mnl_cb_t data_cb;
+	nl_cb_t cb;
+	void *data;
+
+	/* mirror entry to revert if the kernel refuses */
+	bool mirrored;
+	struct nl_key key;
+	/* nexthop object to forget if the kernel refuses */
+	uint32_t nh_id;
+};
+
+/* nexthop object, one per neighbor which is used as gateway. The upstream
+ * one is used by the default route only and is replaced on parent switch.
+ */
+struct nl_nh {
+	uint32_t id;
+	uint32_t ifindex;
+	struct in6_addr via;
+	bool upstream;
+	/* kernel refused it, gets freed when the last route is gone */
+	bool dead;
+
+	unsigned int refcnt;
+	struct list list;
+};
+
+/* routing table and protocol of our routes on an interface */
+struct nl_rt {
+	uint32_t ifindex;
+	uint32_t table;
+	uint8_t proto;
+
+	/* routes of a previous run which were not installed again */
+	ev_timer stale_w;
+	nl_route_cb_t route_cb;
+	void *route_data;
+
+	struct list list;
+};
+
+/* one of our routes as found by a dump */
+struct nl_dump_route {
+	struct in6_prefix dst;
+	uint32_t table;
+	uint8_t proto;
+	uint32_t oif;
+	struct in6_addr via;
+	uint32_t nh_id;
+};
+
+struct nl_flush {
+	struct nl_rt rt;
+	nl_cb_t cb;
+	void *data;
+
+	struct nl_dump_route *routes;
+	int routes_count;
+	uint32_t *nh_ids;
+	int nh_ids_count;
+};
+
+/* a request built while every slot was in flight, it gets its seq and
+ * slot when one is free again.
+ */
+struct nl_queued {
+	struct nl_req req;
+	struct list list;
+
+	unsigned char msg[];
+};
+
+/* shadow of the kernel state we installed, used to only send deltas */
+struct nl_mirror {
+	struct nl_key key;
+	/* route points to this nexthop object, if any */
+	struct nl_nh *nh;
+	/* found at startup, not installed again by us yet */
+	bool stale;
+
+	struct list list;
+};
+
+static struct mnl_socket *nl;
+static unsigned int portid;
+static uint32_t nl_seq;
+
+static unsigned char batch_buf[NL_BATCH_LIMIT * 2];
+static struct mnl_nlmsg_batch *batch;
+static struct nl_req reqs[NL_REQS_MAX];
+static unsigned int inflight;
+/* messages wait here while the slots are full, in order */
+static struct list_head queued;
+static unsigned char queued_buf[NL_BATCH_LIMIT];
+static struct list_head mirror[NL_MIRROR_BUCKETS];
+
+static bool nh_supported;
+static struct list_head nhs;
+static uint32_t nh_next_id = NL_NH_ID_BASE;
+
+static struct list_head rts;
+
+/* the kernel allows one dump at a time per socket, operations which
+ * dump wait here until the running one is done.
+ */
+struct nl_dump_op {
+	void (*start)(void *data);
+	void *data;
+
+	struct list list;
+};
+
+static struct list_head dump_ops;
+static bool dump_busy;
+
+/* without configuration we behave like before */
+static const struct nl_rt rt_default = {
+	.table = RT_TABLE_MAIN,
+	.proto = RTPROT_STATIC,
+};
+
+static struct ev_loop *nl_loop;
+static ev_prepare batch_w;
+static ev_io recv_w;
+
+/* link and address cache kept current by the monitor socket */
+static struct mnl_socket *nlmon;
+static ev_io mon_w;
+static struct list_head links;
+static nl_link_cb_t link_cb;
+static void *link_cb_data;
+static nl_neigh_cb_t neigh_cb;
+static void *neigh_cb_data;
+
+static const char *nl_type_str(uint16_t type)
+{
+	switch (type) {
+	case RTM_GETLINK:
+		return "RTM_GETLINK";
+	case RTM_GETADDR:
+		return "RTM_GETADDR";
+	case RTM_NEWADDR:
+		return "RTM_NEWADDR";
+	case RTM_NEWROUTE:
+		return "RTM_NEWROUTE";
+	case RTM_DELROUTE:
+		return "RTM_DELROUTE";
+	case RTM_NEWNEXTHOP:
+		return "RTM_NEWNEXTHOP";
+	case RTM_DELNEXTHOP:
+		return "RTM_DELNEXTHOP";
+	case RTM_GETNEXTHOP:
+		return "RTM_GETNEXTHOP";
+	case RTM_GETROUTE:
+		return "RTM_GETROUTE";
+	case RTM_NEWRULE:
+		return "RTM_NEWRULE";
+	case RTM_DELRULE:
+		return "RTM_DELRULE";
+	default:
+		return "unknown";
+	}
+}
+
+static void nl_key_init(struct nl_key *key, uint16_t type, uint32_t ifindex,
+			const struct in6_addr *dst, uint8_t dst_len,
+			const struct in6_addr *via)
+{
+	memset(key, 0, sizeof(*key));
+	key->type = type;
+	key->ifindex = ifindex;
+	if (dst)
+		key->dst.prefix = *dst;
+	key->dst.len = dst_len;
+	if (via)
+		key->via = *via;
+}
+
+static bool nl_key_equal(const struct nl_key *a, const struct nl_key *b)
+{
+	return a->type == b->type && a->ifindex == b->ifindex &&
+	       a->dst.len == b->dst.len && a->segs == b->segs &&
+	       !memcmp(&a->dst.prefix, &b->dst.prefix, sizeof(a->dst.prefix)) &&
+	       !memcmp(&a->via, &b->via, sizeof(a->via));
+}
+
+/* FNV-1a, the gateway is not part of it so the same destination via
+ * another gateway is found in the same bucket.
+ */
+static uint32_t nl_key_hash(const struct nl_key *key)
+{
+	const uint8_t *p;
+	uint32_t h = 2166136261u;
+	size_t i;
+
+#define NL_HASH(v) do {					\
+		p = (const uint8_t *)&(v);			\
+		for (i = 0; i < sizeof(v); i++)			\
+			h = (h ^ p[i]) * 16777619u;		\
+	} while (0)
+
+	NL_HASH(key->type);
+	NL_HASH(key->ifindex);
+	NL_HASH(key->dst.prefix);
+	NL_HASH(key->dst.len);
+#undef NL_HASH
+
+	return h;
+}
+
+static struct list_head *nl_mirror_bucket(const struct nl_key *key)
+{
+	return &mirror[nl_key_hash(key) & (NL_MIRROR_BUCKETS - 1)];
+}
+
+static struct nl_mirror *nl_mirror_lookup(const struct nl_key *key)
+{
+	struct nl_mirror *m;
+	struct list *e;
+
+	DL_FOREACH(nl_mirror_bucket(key)->head, e) {
+		m = container_of(e, struct nl_mirror, list);
+		if (nl_key_equal(&m->key, key))
+			return m;
+	}
+
+	return NULL;
+}
+
+/* same destination, any gateway */
+static struct nl_mirror *nl_mirror_lookup_dst(const struct nl_key *key)
+{
+	struct nl_mirror *m;
+	struct list *e;
+
+	DL_FOREACH(nl_mirror_bucket(key)->head, e) {
+		m = container_of(e, struct nl_mirror, list);
+		if (m->key.type == key->type &&
+		    m->key.ifindex == key->ifindex &&
+		    m->key.dst.len == key->dst.len &&
+		    !memcmp(&m->key.dst.prefix, &key->dst.prefix,
+			    sizeof(key->dst.prefix)))
+			return m;
+	}
+
+	return NULL;
+}
+
+/* copies the key, a commit whose send fails runs completions which may
+ * free the entry.
+ */
+static bool nl_mirror_lookup_dst_key(const struct nl_key *key,
+				     struct nl_key *old)
+{
+	const struct nl_mirror *m = nl_mirror_lookup_dst(key);
+
+	if (!m)
+		return false;
+
+	*old = m->key;
+	return true;
+}
+
+static void nl_nh_put(struct nl_nh *nh);
+static void nl_nh_kill(uint32_t id);
+
+/* takes over the reference of nh */
+static int nl_mirror_insert(const struct nl_key *key, struct nl_nh *nh)
+{
+	struct nl_mirror *m;
+
+	m = mzalloc(sizeof(*m));
+	if (!m)
+		return -1;
+
+	m->key = *key;
+	m->nh = nh;
+	DL_APPEND(nl_mirror_bucket(key)->head, &m->list);
+	return 0;
+}
+
+static void nl_mirror_remove(const struct nl_key *key)
+{
+	struct list_head *bucket = nl_mirror_bucket(key);
+	struct nl_mirror *m;
+
+	m = nl_mirror_lookup(key);
+	if (!m)
+		return;
+
+	DL_DELETE(bucket->head, &m->list);
+	nl_nh_put(m->nh);
+	free(m);
+}
+
+/* forget our routes on ifindex, the kernel side is done by a flush */
+static void nl_mirror_flush(uint32_t ifindex)
+{
+	struct list *e, *tmp;
+	struct nl_mirror *m;
+	int i;
+
+	for (i = 0; i < NL_MIRROR_BUCKETS; i++) {
+		DL_FOREACH_SAFE(mirror[i].head, e, tmp) {
+			m = container_of(e, struct nl_mirror, list);
+			if (m->key.type != RTM_NEWROUTE ||
+			    m->key.ifindex != ifindex)
+				continue;
+
+			DL_DELETE(mirror[i].head, e);
+			/* the flush deletes the nexthop objects as well */
+			if (m->nh)
+				m->nh->dead = true;
+			nl_nh_put(m->nh);
+			free(m);
+		}
+	}
+}
+
+static void nl_mirror_free(void)
+{
+	struct nl_mirror *m;
+	struct list *e, *tmp;
+	int i;
+
+	for (i = 0; i < NL_MIRROR_BUCKETS; i++) {
+		DL_FOREACH_SAFE(mirror[i].head, e, tmp) {
+			m = container_of(e, struct nl_mirror, list);
+			DL_DELETE(mirror[i].head, e);
+			free(m);
+		}
+	}
+}
+
+static uint32_t nl_next_seq(void)
+{
+	/* zero disables sequence checking in libmnl */
+	if (++nl_seq == 0)
+		nl_seq = 1;
+
+	return nl_seq;
+}
+
+/* the slot of the next seq is still in flight */
+static bool nl_reqs_full(void)
+{
+	return reqs[(nl_seq + 1 ? nl_seq + 1 : 1) & (NL_REQS_MAX - 1)].pending;
+}
+
+/* never waits, with every slot in flight the message is queued and gets
+ * its seq when it goes out.
+ */
+static struct nlmsghdr *nl_batch_put_header(uint16_t type, uint16_t flags)
+{
+	struct nlmsghdr *nlh;
+
+	if (queued.head || nl_reqs_full()) {
+		nlh = mnl_nlmsg_put_header(queued_buf);
+	} else {
+		nlh = mnl_nlmsg_put_header(mnl_nlmsg_batch_current(batch));
+		nlh->nlmsg_seq = nl_next_seq();
+	}
+
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+
+	return nlh;
+}
+
+static void nl_req_complete(struct nl_req *req, int err)
+{
+	req->pending = false;
+	inflight--;
+
+	switch (-err) {
+	case 0:
+		goto out;
+	case EOPNOTSUPP:
+	case EINVAL:
+		/* kernel without nexthop objects */
+		if (req->type == RTM_GETNEXTHOP)
+			goto out;
+		break;
+	case EEXIST:
+		/* we add things again, this is fine */
+		if (req->type != RTM_DELROUTE) {
+			dlog(LOG_DEBUG, 3, "netlink %s seq %u: %s",
+			     nl_type_str(req->type), req->seq,
+			     strerror(-err));
+			goto out;
+		}
+		break;
+	case ENOENT:
+	case ESRCH:
+		/* route, nexthop or rule is already gone */
+		if (req->type == RTM_DELROUTE || req->type == RTM_DELNEXTHOP ||
+		    req->type == RTM_DELRULE) {
+			dlog(LOG_DEBUG, 3, "netlink %s seq %u: %s",
+			     nl_type_str(req->type), req->seq,
+			     strerror(-err));
+			goto out;
+		}
+		break;
+	default:
+		break;
+	}
+
+	flog(LOG_ERR, "netlink %s seq %u failed: %s",
+	     nl_type_str(req->type), req->seq, strerror(-err));
+
+	/* kernel has not what we think, try again next time */
+	if (req->mirrored && req->type != RTM_DELROUTE)
+		nl_mirror_remove(&req->key);
+	if (req->nh_id && req->type == RTM_NEWNEXTHOP)
+		nl_nh_kill(req->nh_id);
+
+out:
+	if (req->cb)
+		req->cb(err, req->data);
+}
+
+static struct nl_req *nl_req_lookup(uint32_t seq)
+{
+	struct nl_req *req = &reqs[seq & (NL_REQS_MAX - 1)];
+
+	if (!req->pending || req->seq != seq)
+		return NULL;
+
+	return req;
+}
+
+/* fail the requests of a batch which never hit the kernel */
+static void nl_batch_drop(const uint32_t *seqs, int count, int err)
+{
+	struct nl_req *req;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		req = nl_req_lookup(seqs[i]);
+		if (req)
+			nl_req_complete(req, err);
+	}
+}
+
+static void nl_batch_send(void)
+{
+	uint32_t seqs[NL_BATCH_LIMIT / NLMSG_HDRLEN];
+	const struct nlmsghdr *nlh;
+	int len, count = 0;
+	int err = 0;
+	ssize_t rc;
+
+	if (mnl_nlmsg_batch_is_empty(batch))
+		return;
+
+	len = mnl_nlmsg_batch_size(batch);
+	rc = mnl_socket_sendto(nl, mnl_nlmsg_batch_head(batch), len);
+	if (rc < 0) {
+		err = errno;
+		flog(LOG_ERR, "netlink batch send failed: %s", strerror(err));
+
+		for (nlh = mnl_nlmsg_batch_head(batch); mnl_nlmsg_ok(nlh, len);
+		     nlh = mnl_nlmsg_next(nlh, &len))
+			seqs[count++] = nlh->nlmsg_seq;
+	}
+
+	/* completions may add to the batch, so they run after the reset */
+	mnl_nlmsg_batch_reset(batch);
+	nl_batch_drop(seqs, count, -err);
+}
+
+static void nl_req_init(struct nl_req *req, const struct nlmsghdr *nlh,
+			const struct nl_key *key, mnl_cb_t data_cb,
+			nl_cb_t cb, void *data)
+{
+	req->seq = nlh->nlmsg_seq;
+	req->type = nlh->nlmsg_type;
+	req->mirrored = !!key;
+	if (key)
+		req->key = *key;
+	req->nh_id = 0;
+	req->data_cb = data_cb;
+	req->cb = cb;
+	req->data = data;
+}
+
+/* takes the slot of seq, it must be free */
+static struct nl_req *nl_req_pend(struct nl_req *req)
+{
+	struct nl_req *slot = &reqs[req->seq & (NL_REQS_MAX - 1)];
+
+	*slot = *req;
+	slot->pending = true;
+	inflight++;
+
+	return slot;
+}
+
+static void nl_batch_next(void)
+{
+	/* batch is full, send everything before this message */
+	if (!mnl_nlmsg_batch_next(batch))
+		nl_batch_send();
+}
+
+/* NULL if the request failed already, its callback has run then */
+static struct nl_req *nl_batch_track(const struct nlmsghdr *nlh,
+				     const struct nl_key *key,
+				     mnl_cb_t data_cb, nl_cb_t cb, void *data)
+{
+	struct nl_req req = {}, *slot;
+	struct nl_queued *q;
+
+	nl_req_init(&req, nlh, key, data_cb, cb, data);
+
+	if ((const unsigned char *)nlh != queued_buf) {
+		slot = nl_req_pend(&req);
+		nl_batch_next();
+		return slot;
+	}
+
+	q = malloc(sizeof(*q) + nlh->nlmsg_len);
+	if (!q) {
+		/* as if the kernel refused it, reverts the mirror */
+		req.pending = true;
+		inflight++;
+		nl_req_complete(&req, -ENOMEM);
+		return NULL;
+	}
+
+	q->req = req;
+	memcpy(q->msg, nlh, nlh->nlmsg_len);
+	DL_APPEND(queued.head, &q->list);
+
+	return &q->req;
+}
+
+static int nl_batch_commit(const struct nlmsghdr *nlh,
+			   const struct nl_key *key, mnl_cb_t data_cb,
+			   nl_cb_t cb, void *data)
+{
+	nl_batch_track(nlh, key, data_cb, cb, data);
+	return 0;
+}
+
+/* queued messages go out in order while slots are free */
+static void nl_queue_flush(void)
+{
+	struct nlmsghdr *nlh;
+	struct nl_queued *q;
+
+	while (queued.head && !nl_reqs_full()) {
+		q = container_of(queued.head, struct nl_queued, list);
+		DL_DELETE(queued.head, &q->list);
+
+		nlh = mnl_nlmsg_batch_current(batch);
+		memcpy(nlh, q->msg, ((struct nlmsghdr *)q->msg)->nlmsg_len);
+		nlh->nlmsg_seq = nl_next_seq();
+		q->req.seq = nlh->nlmsg_seq;
+		nl_req_pend(&q->req);
+		free(q);
+
+		nl_batch_next();
+	}
+}
+
+static void nl_queue_free(void)
+{
+	struct list *e, *tmp;
+
+	DL_FOREACH_SAFE(queued.head, e, tmp) {
+		DL_DELETE(queued.head, e);
+		free(container_of(e, struct nl_queued, list));
+	}
+}
+
+/* nothing to send, but the caller still wants to know */
+static int nl_complete_now(nl_cb_t cb, void *data)
+{
+	if (cb)
+		cb(0, data);
+
+	return 0;
+}
+
+static void nl_dump_next(void)
+{
+	struct nl_dump_op *op;
+
+	dump_busy = !!dump_ops.head;
+	if (!dump_busy)
+		return;
+
+	op = container_of(dump_ops.head, struct nl_dump_op, list);
+	DL_DELETE(dump_ops.head, &op->list);
+	op->start(op->data);
+	free(op);
+}
+
+static int nl_dump_queue(void (*start)(void *data), void *data)
+{
+	struct nl_dump_op *op;
+
+	op = mzalloc(sizeof(*op));
+	if (!op)
+		return -1;
+
+	op->start = start;
+	op->data = data;
+	DL_APPEND(dump_ops.head, &op->list);
+
+	if (!dump_busy)
+		nl_dump_next();
+
+	return 0;
+}
+
+/* the running operation has no dump left, the next one may start */
+static void nl_dump_done(void)
+{
+	nl_dump_next();
+}
+
+static void nl_dump_ops_free(void)
+{
+	struct list *e, *tmp;
+
+	DL_FOREACH_SAFE(dump_ops.head, e, tmp) {
+		DL_DELETE(dump_ops.head, e);
+		free(container_of(e, struct nl_dump_op, list));
+	}
+
+	dump_busy = false;
+}
+
+static struct nl_nh *nl_nh_lookup_id(uint32_t id)
+{
+	struct nl_nh *nh;
+	struct list *e;
+
+	DL_FOREACH(nhs.head, e) {
+		nh = container_of(e, struct nl_nh, list);
+		if (nh->id == id)
+			return nh;
+	}
+
+	return NULL;
+}
+
+static struct nl_nh *nl_nh_lookup(uint32_t ifindex, const struct in6_addr *via)
+{
+	struct nl_nh *nh;
+	struct list *e;
+
+	DL_FOREACH(nhs.head, e) {
+		nh = container_of(e, struct nl_nh, list);
+		if (!nh->dead && !nh->upstream && nh->ifindex == ifindex &&
+		    !memcmp(&nh->via, via, sizeof(*via)))
+			return nh;
+	}
+
+	return NULL;
+}
+
+static uint32_t nl_nh_alloc_id(void)
+{
+	uint32_t id;
+
+	/* skip ids which are still in use after a wrap around */
+	do {
+		id = nh_next_id++;
+	} while (!id || nl_nh_lookup_id(id));
+
+	return id;
+}
+
+static const struct nl_rt *nl_rt_lookup(uint32_t ifindex)
+{
+	struct nl_rt *rt;
+	struct list *e;
+
+	DL_FOREACH(rts.head, e) {
+		rt = container_of(e, struct nl_rt, list);
+		if (rt->ifindex == ifindex)
+			return rt;
+	}
+
+	return &rt_default;
+}
+
+static void nl_rts_free(void)
+{
+	struct list *e, *tmp;
+	struct nl_rt *rt;
+
+	DL_FOREACH_SAFE(rts.head, e, tmp) {
+		rt = container_of(e, struct nl_rt, list);
+		ev_timer_stop(nl_loop, &rt->stale_w);
+		DL_DELETE(rts.head, e);
+		free(rt);
+	}
+}
+
+/* creates the nexthop or replaces the gateway of an existing one */
+static void nl_nh_send(const struct nl_nh *nh, nl_cb_t cb, void *data)
+{
+	struct nlmsghdr *nlh;
+	struct nl_req *req;
+	struct nhmsg *nhm;
+
+	nlh = nl_batch_put_header(RTM_NEWNEXTHOP, NLM_F_CREATE | NLM_F_REPLACE);
+	nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(*nhm));
+	nhm->nh_family = AF_INET6;
+	nhm->nh_protocol = nl_rt_lookup(nh->ifindex)->proto;
+
+	mnl_attr_put_u32(nlh, NHA_ID, nh->id);
+	mnl_attr_put(nlh, NHA_GATEWAY, sizeof(nh->via), &nh->via);
+	mnl_attr_put_u32(nlh, NHA_OIF, nh->ifindex);
+
+	req = nl_batch_track(nlh, NULL, NULL, cb, data);
+	if (req)
+		req->nh_id = nh->id;
+	else
+		nl_nh_kill(nh->id);
+}
+
+/* returns a referenced nexthop object, NULL if not supported */
+static struct nl_nh *nl_nh_get(uint32_t ifindex, const struct in6_addr *via,
+			       bool upstream, int *rc)
+{
+	struct nl_nh *nh;
+
+	*rc = 0;
+	if (!nh_supported)
+		return NULL;
+
+	if (!upstream) {
+		nh = nl_nh_lookup(ifindex, via);
+		if (nh) {
+			nh->refcnt++;
+			return nh;
+		}
+	}
+
+	nh = mzalloc(sizeof(*nh));
+	if (!nh) {
+		*rc = -1;
+		return NULL;
+	}
+
+	nh->id = nl_nh_alloc_id();
+	nh->ifindex = ifindex;
+	nh->via = *via;
+	nh->upstream = upstream;
+	nh->refcnt = 1;
+	DL_APPEND(nhs.head, &nh->list);
+
+	nl_nh_send(nh, NULL, NULL);
+	return nh;
+}
+
+/* must be called after the route which used it is gone or re-pointed */
+static void nl_nh_put(struct nl_nh *nh)
+{
+	struct nlmsghdr *nlh;
+	struct nhmsg *nhm;
+
+	if (!nh || --nh->refcnt)
+		return;
+
+	if (!nh->dead) {
+		nlh = nl_batch_put_header(RTM_DELNEXTHOP, 0);
+		nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(*nhm));
+		nhm->nh_family = AF_UNSPEC;
+		mnl_attr_put_u32(nlh, NHA_ID, nh->id);
+		nl_batch_commit(nlh, NULL, NULL, NULL, NULL);
+	}
+
+	DL_DELETE(nhs.head, &nh->list);
+	free(nh);
+}
+
+static void nl_nh_kill(uint32_t id)
+{
+	struct nl_nh *nh;
+
+	nh = nl_nh_lookup_id(id);
+	if (nh)
+		nh->dead = true;
+}
+
+static void nl_nh_free(void)
+{
+	struct list *e, *tmp;
+	struct nl_nh *nh;
+
+	DL_FOREACH_SAFE(nhs.head, e, tmp) {
+		nh = container_of(e, struct nl_nh, list);
+		DL_DELETE(nhs.head, e);
+		free(nh);
+	}
+}
+
+static void nl_nh_probe_done(int err, void *data)
+{
+	nh_supported = !err;
+	if (!nh_supported)
+		flog(LOG_INFO, "no nexthop object support, use gateway routes");
+
+	nl_dump_done();
+}
+
+static void nl_nh_probe(void *data)
+{
+	struct nlmsghdr *nlh;
+	struct nhmsg *nhm;
+
+	nlh = nl_batch_put_header(RTM_GETNEXTHOP, NLM_F_DUMP);
+	nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(*nhm));
+	nhm->nh_family = AF_INET6;
+
+	nl_batch_commit(nlh, NULL, NULL, nl_nh_probe_done, NULL);
+}
+
+/* tables above 255 only fit into the attribute */
+static void nl_route_put_table(struct nlmsghdr *nlh, struct rtmsg *rtm,
+			       const struct nl_rt *rt)
+{
+	rtm->rtm_table = rt->table < 256 ? rt->table : RT_TABLE_UNSPEC;
+	mnl_attr_put_u32(nlh, RTA_TABLE, rt->table);
+}
+
+/* gateway either through the nexthop object or directly */
+static void nl_route_put_via(struct nlmsghdr *nlh, uint32_t ifindex,
+			     const struct in6_addr *via,
+			     const struct nl_nh *nh)
+{
+	if (nh) {
+		mnl_attr_put_u32(nlh, RTA_NH_ID, nh->id);
+		return;
+	}
+
+	if (via)
+		mnl_attr_put(nlh, RTA_GATEWAY, sizeof(*via), via);
+	mnl_attr_put_u32(nlh, RTA_OIF, ifindex);
+}
+
+static void nl_handle_msg(const struct nlmsghdr *nlh)
+{
+	const struct nlmsgerr *err;
+	struct nl_req *req;
+
+	if (nlh->nlmsg_pid != portid)
+		return;
+
+	req = nl_req_lookup(nlh->nlmsg_seq);
+	if (!req) {
+		dlog(LOG_DEBUG, 3, "netlink message for unknown seq %u",
+		     nlh->nlmsg_seq);
+		return;
+	}
+
+	switch (nlh->nlmsg_type) {
+	case NLMSG_ERROR:
+		err = mnl_nlmsg_get_payload(nlh);
+		if (nlh->nlmsg_len < mnl_nlmsg_size(sizeof(*err)))
+			return;
+
+		nl_req_complete(req, err->error);
+		break;
+	case NLMSG_DONE:
+		/* end of a dump, may carry an error code */
+		if (nlh->nlmsg_len >= mnl_nlmsg_size(sizeof(int)))
+			nl_req_complete(req, *(int *)mnl_nlmsg_get_payload(nlh));
+		else
+			nl_req_complete(req, 0);
+		break;
+	case NLMSG_NOOP:
+	case NLMSG_OVERRUN:
+		break;
+	default:
+		if (req->data_cb && req->data_cb(nlh, req->data) == MNL_CB_ERROR)
+			flog(LOG_ERR, "netlink %s seq %u bad reply",
+			     nl_type_str(req->type), req->seq);
+		break;
+	}
+}
+
+/* fail everything in flight, we can't match the replies anymore */
+static void nl_fail_inflight(int err)
+{
+	int i;
+
+	for (i = 0; i < NL_REQS_MAX; i++) {
+		if (reqs[i].pending)
+			nl_req_complete(&reqs[i], err);
+	}
+}
+
+/* returns -1 with EAGAIN when the socket is drained */
+static int nl_recv(void)
+{
+	unsigned char buf[MNL_SOCKET_DUMP_SIZE];
+	const struct nlmsghdr *nlh;
+	int len;
+
+	len = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	if (len == -1) {
+		if (errno == ENOBUFS) {
+			flog(LOG_WARNING, "netlink replies overrun, lost track of requests");
+			nl_fail_inflight(-ENOBUFS);
+		} else if (errno != EAGAIN && errno != EINTR) {
+			flog(LOG_ERR, "netlink recv failed: %s",
+			     strerror(errno));
+		}
+
+		return -1;
+	}
+
+	for (nlh = (const struct nlmsghdr *)buf; mnl_nlmsg_ok(nlh, len);
+	     nlh = mnl_nlmsg_next(nlh, &len))
+		nl_handle_msg(nlh);
+
+	return 0;
+}
+
+/* acks free slots, the prepare watcher sends what got queued */
+static void nl_recv_cb(EV_P_ ev_io *w, int revents)
+{
+	while (nl_recv() == 0)
+		;
+
+	nl_queue_flush();
+}
+
+/* only for startup and shutdown where the event loop is not running,
+ * blocks until everything is answered.
+ */
+int netlink_sync(void)
+{
+	struct pollfd pfd = {
+		.fd = mnl_socket_get_fd(nl),
+		.events = POLLIN,
+	};
+	int rc;
+
+	while (inflight || queued.head) {
+		/* completions may queue follow up requests */
+		nl_queue_flush();
+		nl_batch_send();
+
+		rc = poll(&pfd, 1, NL_SYNC_TIMEOUT_MS);
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc <= 0) {
+			flog(LOG_ERR, "netlink sync timed out");
+			nl_fail_inflight(-ETIMEDOUT);
+			return -1;
+		}
+
+		while (nl_recv() == 0)
+			;
+	}
+
+	return 0;
+}
+
+static struct nl_link *nl_link_lookup_by_index(uint32_t ifindex)
+{
+	struct nl_link *link;
+	struct list *e;
+
+	DL_FOREACH(links.head, e) {
+		link = container_of(e, struct nl_link, list);
+		if (link->ifindex == ifindex)
+			return link;
+	}
+
+	return NULL;
+}
+
+const struct nl_link *nl_link_lookup(const char *ifname)
+{
+	struct nl_link *link;
+	struct list *e;
+
+	DL_FOREACH(links.head, e) {
+		link = container_of(e, struct nl_link, list);
+		if (!strncmp(link->ifname, ifname, IFNAMSIZ))
+			return link;
+	}
+
+	return NULL;
+}
+
+static void nl_link_free(struct nl_link *link)
+{
+	free(link->llinfo.addr);
+	free(link->addrs);
+	free(link);
+}
+
+static void nl_links_free(void)
+{
+	struct nl_link *link;
+	struct list *e, *tmp;
+
+	DL_FOREACH_SAFE(links.head, e, tmp) {
+		link = container_of(e, struct nl_link, list);
+		DL_DELETE(links.head, e);
+		nl_link_free(link);
+	}
+}
+
+static void nl_link_notify(const struct nl_link *link)
+{
+	if (link_cb)
+		link_cb(link, link_cb_data);
+}
+
+static int link_attr_cb(const struct nlattr *attr, void *data)
+{
+	int type = mnl_attr_get_type(attr);
+	const struct nlattr **tb = data;
+
+	if (mnl_attr_type_valid(attr, IFLA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case IFLA_LINK:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
+			return MNL_CB_ERROR;
+		break;
+	case IFLA_IFNAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_NUL_STRING) < 0)
+			return MNL_CB_ERROR;
+		break;
+	case IFLA_ADDRESS:
+		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0)
+			return MNL_CB_ERROR;
+		break;
+	default:
+		break;
+	}
+
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int link_msg_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[IFLA_MAX + 1] = {};
+	struct nl_link *link;
+	unsigned char *addr;
+	uint8_t addr_len;
+
+	if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK)
+		return MNL_CB_OK;
+
+	if (mnl_attr_parse(nlh, sizeof(*ifm), link_attr_cb, tb) < 0)
+		return MNL_CB_ERROR;
+
+	link = nl_link_lookup_by_index(ifm->ifi_index);
+	if (nlh->nlmsg_type == RTM_DELLINK) {
+		if (link) {
+			flog(LOG_WARNING, "link %s removed", link->ifname);
+			DL_DELETE(links.head, &link->list);
+			nl_link_free(link);
+		}
+
+		return MNL_CB_OK;
+	}
+
+	if (!link) {
+		link = mzalloc(sizeof(*link));
+		if (!link)
+			return MNL_CB_ERROR;
+
+		link->ifindex = ifm->ifi_index;
+		DL_APPEND(links.head, &link->list);
+	}
+
+	if (tb[IFLA_IFNAME])
+		strncpy(link->ifname, mnl_attr_get_str(tb[IFLA_IFNAME]),
+			IFNAMSIZ - 1);
+
+	/* TODO this will not available on bluetooth */
+	if (tb[IFLA_LINK])
+		link->llinfo.ifindex = mnl_attr_get_u32(tb[IFLA_LINK]);
+
+	if (tb[IFLA_ADDRESS]) {
+		addr_len = mnl_attr_get_payload_len(tb[IFLA_ADDRESS]);
+		if (addr_len != link->llinfo.addr_len ||
+		    memcmp(link->llinfo.addr,
+			   mnl_attr_get_payload(tb[IFLA_ADDRESS]), addr_len)) {
+			addr = mzalloc(addr_len);
+			if (!addr)
+				return MNL_CB_ERROR;
+
+			memcpy(addr, mnl_attr_get_payload(tb[IFLA_ADDRESS]),
+			       addr_len);
+			free(link->llinfo.addr);
+			link->llinfo.addr = addr;
+			link->llinfo.addr_len = addr_len;
+		}
+	}
+
+	nl_link_notify(link);
+	return MNL_CB_OK;
+}
+
+static int nl_link_addr_index(const struct nl_link *link,
+			      const struct in6_addr *addr)
+{
+	int i;
+
+	for (i = 0; i < link->addrs_count; i++) {
+		if (!memcmp(&link->addrs[i], addr, sizeof(*addr)))
+			return i;
+	}
+
+	return -1;
+}
+
+/* keeps the array in ascending order, so the output is predictable */
+static int nl_link_addr_add(struct nl_link *link, const struct in6_addr *addr)
+{
+	struct in6_addr *addrs;
+	int i;
+
+	if (nl_link_addr_index(link, addr) != -1)
+		return 0;
+
+	addrs = realloc(link->addrs, (link->addrs_count + 1) * sizeof(*addrs));
+	if (!addrs)
+		return -1;
+
+	for (i = link->addrs_count; i > 0; i--) {
+		if (memcmp(&addrs[i - 1], addr, sizeof(*addr)) < 0)
+			break;
+
+		addrs[i] = addrs[i - 1];
+	}
+
+	addrs[i] = *addr;
+	link->addrs = addrs;
+	link->addrs_count++;
+	return 0;
+}
+
+static void nl_link_addr_del(struct nl_link *link, const struct in6_addr *addr)
+{
+	int i;
+
+	i = nl_link_addr_index(link, addr);
+	if (i == -1)
+		return;
+
+	memmove(&link->addrs[i], &link->addrs[i + 1],
+		(link->addrs_count - i - 1) * sizeof(*addr));
+	link->addrs_count--;
+}
+
+static int addr_msg_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct ifaddrmsg *ifa = mnl_nlmsg_get_payload(nlh);
+	const struct nlattr *attr, *address = NULL;
+	struct nl_link *link;
+	int rc = 0;
+
+	if (nlh->nlmsg_type != RTM_NEWADDR && nlh->nlmsg_type != RTM_DELADDR)
+		return MNL_CB_OK;
+
+	if (ifa->ifa_family != AF_INET6)
+		return MNL_CB_OK;
+
+	mnl_attr_for_each(attr, nlh, sizeof(*ifa)) {
+		if (mnl_attr_get_type(attr) != IFA_ADDRESS)
+			continue;
+
+		if (mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+				       sizeof(struct in6_addr)) < 0)
+			return MNL_CB_ERROR;
+
+		address = attr;
+	}
+
+	link = nl_link_lookup_by_index(ifa->ifa_index);
+	if (!link || !address)
+		return MNL_CB_OK;
+
+	if (nlh->nlmsg_type == RTM_NEWADDR)
+		rc = nl_link_addr_add(link, mnl_attr_get_payload(address));
+	else
+		nl_link_addr_del(link, mnl_attr_get_payload(address));
+
+	if (rc == -1)
+		return MNL_CB_ERROR;
+
+	nl_link_notify(link);
+	return MNL_CB_OK;
+}
+
+/* only reported, the kernel neighbor table is not cached */
+static int neigh_msg_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct ndmsg *ndm = mnl_nlmsg_get_payload(nlh);
+	const struct nlattr *attr, *dst = NULL;
+
+	if (!neigh_cb || nlh->nlmsg_type != RTM_NEWNEIGH)
+		return MNL_CB_OK;
+
+	if (ndm->ndm_family != AF_INET6)
+		return MNL_CB_OK;
+
+	mnl_attr_for_each(attr, nlh, sizeof(*ndm)) {
+		if (mnl_attr_get_type(attr) != NDA_DST)
+			continue;
+
+		if (mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+				       sizeof(struct in6_addr)) < 0)
+			return MNL_CB_ERROR;
+
+		dst = attr;
+	}
+
+	if (!dst)
+		return MNL_CB_OK;
+
+	neigh_cb(ndm->ndm_ifindex, mnl_attr_get_payload(dst), ndm->ndm_state,
+		 neigh_cb_data);
+	return MNL_CB_OK;
+}
+
+static void nl_addrs_dump_done(int err, void *data)
+{
+	nl_dump_done();
+}
+
+static void nl_links_dump_done(int err, void *data)
+{
+	struct nlmsghdr *nlh;
+	struct ifaddrmsg *ifa;
+
+	if (err) {
+		nl_dump_done();
+		return;
+	}
+
+	/* the kernel only allows one dump at a time per socket */
+	nlh = nl_batch_put_header(RTM_GETADDR, NLM_F_DUMP);
+	ifa = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifa));
+	ifa->ifa_family = AF_INET6;
+
+	nl_batch_commit(nlh, NULL, addr_msg_cb, nl_addrs_dump_done, NULL);
+}
+
+static void nl_links_dump_start(void *data)
+{
+	struct ifinfomsg *ifm;
+	struct nlmsghdr *nlh;
+
+	nl_links_free();
+
+	nlh = nl_batch_put_header(RTM_GETLINK, NLM_F_DUMP);
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
+	ifm->ifi_family = AF_UNSPEC;
+
+	nl_batch_commit(nlh, NULL, link_msg_cb, nl_links_dump_done, NULL);
+}
+
+/* rebuild the whole cache, two dumps regardless of the amount of links */
+static int nl_links_dump(void)
+{
+	return nl_dump_queue(nl_links_dump_start, NULL);
+}
+
+static void nl_mon_cb(EV_P_ ev_io *w, int revents)
+{
+	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
+	const struct nlmsghdr *nlh;
+	int len;
+
+	while (1) {
+		len = mnl_socket_recvfrom(nlmon, buf, sizeof(buf));
+		if (len == -1) {
+			/* lost events, start over */
+			if (errno == ENOBUFS) {
+				flog(LOG_WARNING, "netlink monitor overrun, resync");
+				nl_links_dump();
+			}
+
+			return;
+		}
+
+		for (nlh = (const struct nlmsghdr *)buf; mnl_nlmsg_ok(nlh, len);
+		     nlh = mnl_nlmsg_next(nlh, &len)) {
+			switch (nlh->nlmsg_type) {
+			case RTM_NEWLINK:
+			case RTM_DELLINK:
+				link_msg_cb(nlh, NULL);
+				break;
+			case RTM_NEWADDR:
+			case RTM_DELADDR:
+				addr_msg_cb(nlh, NULL);
+				break;
+			case RTM_NEWNEIGH:
+				neigh_msg_cb(nlh, NULL);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+int nl_links_open(nl_link_cb_t cb, void *data)
+{
+	int rc;
+
+	nlmon = mnl_socket_open(NETLINK_ROUTE);
+	if (!nlmon) {
+		perror("mnl_socket_open");
+		return -1;
+	}
+
+	/* subscribe before the dump so we don't miss anything between */
+	rc = mnl_socket_bind(nlmon, (1 << (RTNLGRP_LINK - 1)) |
+			     (1 << (RTNLGRP_IPV6_IFADDR - 1)) |
+			     (1 << (RTNLGRP_NEIGH - 1)),
+			     MNL_SOCKET_AUTOPID);
+	if (rc < 0) {
+		mnl_socket_close(nlmon);
+		perror("mnl_socket_bind");
+		return -1;
+	}
+
+	rc = fcntl(mnl_socket_get_fd(nlmon), F_GETFL);
+	if (rc == -1 ||
+	    fcntl(mnl_socket_get_fd(nlmon), F_SETFL, rc | O_NONBLOCK) == -1) {
+		mnl_socket_close(nlmon);
+		perror("fcntl");
+		return -1;
+	}
+
+	link_cb = cb;
+	link_cb_data = data;
+
+	rc = nl_links_dump();
+	if (rc == 0)
+		rc = netlink_sync();
+	if (rc == -1) {
+		mnl_socket_close(nlmon);
+		return -1;
+	}
+
+	ev_io_init(&mon_w, nl_mon_cb, mnl_socket_get_fd(nlmon), EV_READ);
+	ev_io_start(nl_loop, &mon_w);
+
+	return 0;
+}
+
+void nl_neighs_monitor(nl_neigh_cb_t cb, void *data)
+{
+	neigh_cb = cb;
+	neigh_cb_data = data;
+}
+
+static void nl_links_close(void)
+{
+	if (!nlmon)
+		return;
+
+	ev_io_stop(nl_loop, &mon_w);
+	mnl_socket_close(nlmon);
+	nl_links_free();
+}
+
+/* flush whatever got queued by this loop iteration before we block again */
+static void nl_batch_cb(EV_P_ ev_prepare *w, int revents)
+{
+	nl_queue_flush();
+	nl_batch_send();
+}
+
+int netlink_open(struct ev_loop *loop)
+{
+	int rcvbuf = NL_RCVBUF_SIZE;
+	int on = 1;
+	int rc;
+
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (!nl) {
+		perror("mnl_socket_open");
+		return -1;
+	}
+
+	rc = mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID);
+	if (rc < 0) {
+		mnl_socket_close(nl);
+		perror("mnl_socket_bind");
+		return -1;
+	}
+	portid = mnl_socket_get_portid(nl);
+
+	/* never block the event loop, replies come via ev_io */
+	rc = fcntl(mnl_socket_get_fd(nl), F_GETFL);
+	if (rc == -1 ||
+	    fcntl(mnl_socket_get_fd(nl), F_SETFL, rc | O_NONBLOCK) == -1) {
+		mnl_socket_close(nl);
+		perror("fcntl");
+		return -1;
+	}
+
+	/* acks without the original request, we track them by seq */
+	mnl_socket_setsockopt(nl, NETLINK_CAP_ACK, &on, sizeof(on));
+	/* let the kernel filter our dumps, older kernels ignore it */
+	mnl_socket_setsockopt(nl, NETLINK_GET_STRICT_CHK, &on, sizeof(on));
+	/* a whole batch of acks can arrive at once */
+	setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+		   sizeof(rcvbuf));
+
+	batch = mnl_nlmsg_batch_start(batch_buf, NL_BATCH_LIMIT);
+	if (!batch) {
+		mnl_socket_close(nl);
+		return -1;
+	}
+
+	nl_loop = loop;
+	ev_prepare_init(&batch_w, nl_batch_cb);
+	ev_prepare_start(loop, &batch_w);
+	ev_io_init(&recv_w, nl_recv_cb, mnl_socket_get_fd(nl), EV_READ);
+	ev_io_start(loop, &recv_w);
+
+	if (nl_dump_queue(nl_nh_probe, NULL) == -1) {
+		mnl_socket_close(nl);
+		return -1;
+	}
+
+	return netlink_sync();
+}
+
+void netlink_close()
+{
+	nl_links_close();
+	ev_prepare_stop(nl_loop, &batch_w);
+	ev_io_stop(nl_loop, &recv_w);
+	mnl_nlmsg_batch_stop(batch);
+	mnl_socket_close(nl);
+	nl_dump_ops_free();
+	nl_queue_free();
+	nl_mirror_free();
+	nl_nh_free();
+	nl_rts_free();
+}
+
+bool nl_has_addr(uint32_t ifindex, const struct in6_addr *addr)
+{
+	struct nl_key key;
+
+	nl_key_init(&key, RTM_NEWADDR, ifindex, addr, 64, NULL);
+	return !!nl_mirror_lookup(&key);
+}
+
+int nl_add_addr(uint32_t ifindex, const struct in6_addr *addr, nl_cb_t cb,
+		void *data)
+{
+	const struct nl_link *link;
+	struct ifaddrmsg *ifm;
+	struct nlmsghdr *nlh;
+	struct nl_key key;
+
+	nl_key_init(&key, RTM_NEWADDR, ifindex, addr, 64, NULL);
+	if (nl_mirror_lookup(&key))
+		return nl_complete_now(cb, data);
+
+	if (nl_mirror_insert(&key, NULL) == -1)
+		return -1;
+
+	/* e.g. left by a previous run, the link cache knows */
+	link = nl_link_lookup_by_index(ifindex);
+	if (link && nl_link_addr_index(link, addr) != -1)
+		return nl_complete_now(cb, data);
+
+	nlh = nl_batch_put_header(RTM_NEWADDR, NLM_F_CREATE);
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
+
+	ifm->ifa_index = ifindex;
+	ifm->ifa_family = AF_INET6;
+	ifm->ifa_prefixlen = 64;
+	ifm->ifa_flags = IFA_F_PERMANENT;
+	ifm->ifa_scope = RT_SCOPE_UNIVERSE;
+
+	mnl_attr_put(nlh, IFA_ADDRESS, sizeof(*addr), addr);
+
+	return nl_batch_commit(nlh, &key, NULL, cb, data);
+}
+
+/* a known destination via another gateway is replaced in place, there
+ * is no window without a route.
+ */
+int nl_add_route_via(uint32_t ifindex, const struct in6_addr *dst,
+		     const struct in6_addr *via, nl_cb_t cb, void *data)
+{
+	const struct nl_rt *rt = nl_rt_lookup(ifindex);
+	struct nl_key key, old_key;
+	struct nlmsghdr *nlh;
+	struct nl_mirror *m;
+	struct rtmsg *rtm;
+	struct nl_nh *nh;
+	bool replace;
+	int rc;
+
+	nl_key_init(&key, RTM_NEWROUTE, ifindex, dst, 128, via);
+	m = nl_mirror_lookup(&key);
+	if (m) {
+		m->stale = false;
+		return nl_complete_now(cb, data);
+	}
+
+	nh = nl_nh_get(ifindex, via, false, &rc);
+	if (rc == -1)
+		return -1;
+
+	replace = nl_mirror_lookup_dst_key(&key, &old_key);
+	if (nl_mirror_insert(&key, nh) == -1) {
+		nl_nh_put(nh);
+		return -1;
+	}
+
+	nlh = nl_batch_put_header(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = 128;
+	rtm->rtm_src_len = 0;
+	rtm->rtm_tos = 0;
+	rtm->rtm_protocol = rt->proto;
+	rtm->rtm_type = RTN_UNICAST;
+	/* is there any gateway? */
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+	rtm->rtm_flags = 0;
+
+	nl_route_put_table(nlh, rtm, rt);
+	mnl_attr_put(nlh, RTA_DST, sizeof(*dst), dst);
+	nl_route_put_via(nlh, ifindex, via, nh);
+
+	rc = nl_batch_commit(nlh, &key, NULL, cb, data);
+
+	/* after the replace, this may delete the old nexthop */
+	if (replace)
+		nl_mirror_remove(&old_key);
+
+	return rc;
+}
+
+/* a parent switch is one replace of the upstream nexthop object, without
+ * nexthop support one replace of the default route.
+ */
+int nl_add_route_default(uint32_t ifindex, const struct in6_addr *dst,
+			 nl_cb_t cb, void *data)
+{
+	const struct nl_rt *rt = nl_rt_lookup(ifindex);
+	struct nl_key key, old_key;
+	struct nl_mirror *old;
+	struct nlmsghdr *nlh;
+	struct rtmsg *rtm;
+	struct nl_nh *nh;
+	bool replace;
+	int rc;
+
+	nl_key_init(&key, RTM_NEWROUTE, ifindex, NULL, 0, dst);
+	old = nl_mirror_lookup(&key);
+	if (old) {
+		old->stale = false;
+		return nl_complete_now(cb, data);
+	}
+
+	old = nl_mirror_lookup_dst(&key);
+	if (old && old->nh && !old->nh->dead) {
+		/* the hash doesn't cover the gateway, no rehash needed */
+		old->stale = false;
+		old->key.via = *dst;
+		old->nh->via = *dst;
+		nl_nh_send(old->nh, cb, data);
+		return 0;
+	}
+
+	nh = nl_nh_get(ifindex, dst, true, &rc);
+	if (rc == -1)
+		return -1;
+
+	replace = nl_mirror_lookup_dst_key(&key, &old_key);
+	if (nl_mirror_insert(&key, nh) == -1) {
+		nl_nh_put(nh);
+		return -1;
+	}
+
+	nlh = nl_batch_put_header(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = 0;
+	rtm->rtm_src_len = 0;
+	rtm->rtm_tos = 0;
+	rtm->rtm_protocol = rt->proto;
+	rtm->rtm_type = RTN_UNICAST;
+	/* is there any gateway? */
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+	rtm->rtm_flags = 0;
+
+	nl_route_put_table(nlh, rtm, rt);
+	nl_route_put_via(nlh, ifindex, dst, nh);
+
+	rc = nl_batch_commit(nlh, &key, NULL, cb, data);
+
+	if (replace)
+		nl_mirror_remove(&old_key);
+
+	return rc;
+}
+
+/* FNV-1a 64 bit, changes of the path are found by the mirror */
+static uint64_t nl_segs_hash(const struct in6_addr *segs, int count)
+{
+	const uint8_t *p = (const uint8_t *)segs;
+	uint64_t h = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < count * sizeof(*segs); i++)
+		h = (h ^ p[i]) * 1099511628211ull;
+
+	return h;
+}
+
+/*
+ * Source route to dst in non-storing mode, the lwtunnel RPL encap puts
+ * the packet to segs[0] and the rest with dst into a RPL SRH. Without
+ * segments dst is on link.
+ */
+int nl_add_route_srh(uint32_t ifindex, const struct in6_addr *dst,
+		     const struct in6_addr *segs, int segs_count,
+		     nl_cb_t cb, void *data)
+{
+	unsigned char srh[NL_SRH_HDR_LEN +
+			  NL_SRH_SEGS_MAX * sizeof(struct in6_addr)] = {};
+	const struct nl_rt *rt = nl_rt_lookup(ifindex);
+	struct nl_key key, old_key;
+	struct nlattr *encap;
+	struct nlmsghdr *nlh;
+	struct nl_mirror *m;
+	struct rtmsg *rtm;
+	bool replace;
+	int rc;
+
+	if (segs_count > NL_SRH_SEGS_MAX)
+		return -1;
+
+	nl_key_init(&key, RTM_NEWROUTE, ifindex, dst, 128, NULL);
+	key.segs = nl_segs_hash(segs, segs_count);
+	m = nl_mirror_lookup(&key);
+	if (m) {
+		m->stale = false;
+		return nl_complete_now(cb, data);
+	}
+
+	replace = nl_mirror_lookup_dst_key(&key, &old_key);
+	if (nl_mirror_insert(&key, NULL) == -1)
+		return -1;
+
+	nlh = nl_batch_put_header(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = 128;
+	rtm->rtm_protocol = rt->proto;
+	rtm->rtm_type = RTN_UNICAST;
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+
+	nl_route_put_table(nlh, rtm, rt);
+	mnl_attr_put(nlh, RTA_DST, sizeof(*dst), dst);
+	mnl_attr_put_u32(nlh, RTA_OIF, ifindex);
+
+	if (segs_count) {
+		/* uncompressed, hdrlen and segments left count segs only */
+		srh[1] = segs_count * sizeof(*segs) / 8;
+		srh[2] = NL_SRH_TYPE;
+		srh[3] = segs_count;
+		memcpy(&srh[NL_SRH_HDR_LEN], segs, segs_count * sizeof(*segs));
+
+		mnl_attr_put_u16(nlh, RTA_ENCAP_TYPE, LWTUNNEL_ENCAP_RPL);
+		encap = mnl_attr_nest_start(nlh, RTA_ENCAP);
+		mnl_attr_put(nlh, RPL_IPTUNNEL_SRH,
+			     NL_SRH_HDR_LEN + segs_count * sizeof(*segs), srh);
+		mnl_attr_nest_end(nlh, encap);
+	}
+
+	rc = nl_batch_commit(nlh, &key, NULL, cb, data);
+
+	if (replace)
+		nl_mirror_remove(&old_key);
+
+	return rc;
+}
+
+/* one of our routes, by a copy of its mirror key */
+static int nl_del_mirrored(const struct nl_key *key, nl_cb_t cb, void *data)
+{
+	const struct nl_rt *rt = nl_rt_lookup(key->ifindex);
+	struct nlmsghdr *nlh;
+	struct nl_mirror *m;
+	struct rtmsg *rtm;
+	struct nl_nh *nh;
+	int rc;
+
+	m = nl_mirror_lookup(key);
+	if (!m)
+		return nl_complete_now(cb, data);
+
+	/* m may be gone after the commit */
+	nh = m->nh;
+	if (nh)
+		nh->refcnt++;
+
+	nlh = nl_batch_put_header(RTM_DELROUTE, 0);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = key->dst.len;
+
+	nl_route_put_table(nlh, rtm, rt);
+	mnl_attr_put(nlh, RTA_DST, sizeof(key->dst.prefix), &key->dst.prefix);
+	/* a source route has no gateway */
+	nl_route_put_via(nlh, key->ifindex, key->segs ? NULL : &key->via, nh);
+
+	rc = nl_batch_commit(nlh, NULL, NULL, cb, data);
+
+	/* drops the nexthop after the route is gone */
+	nl_mirror_remove(key);
+	nl_nh_put(nh);
+
+	return rc;
+}
+
+/* without via it's not one of ours, e.g. the kernel prefix route */
+int nl_del_route_via(uint32_t ifindex, const struct in6_prefix *dst,
+		     struct in6_addr *via, nl_cb_t cb, void *data)
+{
+	struct nlmsghdr *nlh;
+	struct nl_key key;
+	struct rtmsg *rtm;
+
+	if (via) {
+		nl_key_init(&key, RTM_NEWROUTE, ifindex, &dst->prefix,
+			    dst->len, via);
+		return nl_del_mirrored(&key, cb, data);
+	}
+
+	nlh = nl_batch_put_header(RTM_DELROUTE, 0);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = dst->len;
+	rtm->rtm_src_len = 0;
+	rtm->rtm_tos = 0;
+	/* is there any gateway? */
+	rtm->rtm_flags = 0;
+
+	nl_route_put_table(nlh, rtm, &rt_default);
+	mnl_attr_put(nlh, RTA_DST, sizeof(dst->prefix), &dst->prefix);
+	nl_route_put_via(nlh, ifindex, NULL, NULL);
+
+	return nl_batch_commit(nlh, NULL, NULL, cb, data);
+}
 
-int netlink_open()
+/* the route to dst we installed, whichever gateway or source route */
+int nl_del_route(uint32_t ifindex, const struct in6_prefix *dst, nl_cb_t cb,
+		 void *data)
 {
-	int rc;
+	struct nl_key key;
 
-	nl = mnl_socket_open(NETLINK_ROUTE);
-	if (!nl) {
-		perror("mnl_socket_open");
-		return -1;
+	nl_key_init(&key, RTM_NEWROUTE, ifindex, &dst->prefix, dst->len,
+		    NULL);
+	if (!nl_mirror_lookup_dst_key(&key, &key))
+		return nl_complete_now(cb, data);
+
+	return nl_del_mirrored(&key, cb, data);
+}
+
+static void nl_rule_send(uint16_t type, uint16_t flags, const struct nl_rt *rt,
+			 uint32_t prio)
+{
+	struct fib_rule_hdr *frh;
+	struct nlmsghdr *nlh;
+
+	nlh = nl_batch_put_header(type, flags);
+	frh = mnl_nlmsg_put_extra_header(nlh, sizeof(*frh));
+	frh->family = AF_INET6;
+	frh->action = FR_ACT_TO_TBL;
+	frh->table = rt->table < 256 ? rt->table : RT_TABLE_UNSPEC;
+
+	mnl_attr_put_u32(nlh, FRA_TABLE, rt->table);
+	mnl_attr_put_u32(nlh, FRA_PRIORITY, prio);
+	mnl_attr_put_u8(nlh, FRA_PROTOCOL, rt->proto);
+	/* routes with a prefix length up to 0 don't match */
+	if (prio == NL_RULE_PRIO)
+		mnl_attr_put_u32(nlh, FRA_SUPPRESS_PREFIXLEN, 0);
+
+	nl_batch_commit(nlh, NULL, NULL, NULL, NULL);
+}
+
+/* interfaces can share a table, there is one rule per table */
+static bool nl_rt_table_used(const struct nl_rt *rt)
+{
+	const struct nl_rt *tmp;
+	struct list *e;
+
+	DL_FOREACH(rts.head, e) {
+		tmp = container_of(e, struct nl_rt, list);
+		if (tmp != rt && tmp->table == rt->table)
+			return true;
 	}
 
-	rc = mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID);
-	if (rc < 0) {
-		mnl_socket_close(nl);
-		perror("mnl_socket_bind");
+	return false;
+}
+
+int nl_set_route_table(uint32_t ifindex, uint32_t table, uint8_t proto)
+{
+	struct nl_rt *rt;
+
+	rt = mzalloc(sizeof(*rt));
+	if (!rt)
 		return -1;
+
+	rt->ifindex = ifindex;
+	rt->table = table;
+	rt->proto = proto;
+
+	/* main is looked up anyway */
+	if (table != RT_TABLE_MAIN && !nl_rt_table_used(rt)) {
+		nl_rule_send(RTM_NEWRULE, NLM_F_CREATE | NLM_F_EXCL, rt,
+			     NL_RULE_PRIO);
+		nl_rule_send(RTM_NEWRULE, NLM_F_CREATE | NLM_F_EXCL, rt,
+			     NL_RULE_PRIO_DEFAULT);
 	}
-	portid = mnl_socket_get_portid(nl);
 
+	DL_APPEND(rts.head, &rt->list);
 	return 0;
 }
 
-void netlink_close()
+void nl_unset_route_table(uint32_t ifindex)
 {
-	mnl_socket_close(nl);
+	struct nl_rt *rt = (struct nl_rt *)nl_rt_lookup(ifindex);
+
+	if (rt == &rt_default)
+		return;
+
+	if (rt->table != RT_TABLE_MAIN && !nl_rt_table_used(rt)) {
+		nl_rule_send(RTM_DELRULE, 0, rt, NL_RULE_PRIO);
+		nl_rule_send(RTM_DELRULE, 0, rt, NL_RULE_PRIO_DEFAULT);
+	}
+
+	ev_timer_stop(nl_loop, &rt->stale_w);
+	DL_DELETE(rts.head, &rt->list);
+	free(rt);
+}
+
+static void nl_flush_finish(int err, void *data)
+{
+	struct nl_flush *f = data;
+
+	/* a delete which raced with someone else is no error */
+	if (err == -ESRCH || err == -ENOENT)
+		err = 0;
+
+	if (err)
+		flog(LOG_ERR, "flush of routes on %u failed: %s",
+		     f->rt.ifindex, strerror(-err));
+
+	if (f->cb)
+		f->cb(err, f->data);
+
+	free(f->routes);
+	free(f->nh_ids);
+	free(f);
+
+	nl_dump_done();
 }
 
-static int data_attr_cb(const struct nlattr *attr, void *data)
+static int route_attr_cb(const struct nlattr *attr, void *data)
 {
 	int type = mnl_attr_get_type(attr);
 	const struct nlattr **tb = data;
 
-	if (mnl_attr_type_valid(attr, IFLA_MAX) < 0)
+	if (mnl_attr_type_valid(attr, NL_RTA_MAX) < 0)
 		return MNL_CB_OK;
 
 	switch(type) {
-	case IFLA_LINK:
-		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
-			perror("mnl_attr_validate");
+	case RTA_TABLE:
+	case RTA_OIF:
+	case RTA_NH_ID:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
 			return MNL_CB_ERROR;
-		}
 		break;
-	case IFLA_ADDRESS:
-		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0) {
-			perror("mnl_attr_validate");
+	case RTA_DST:
+	case RTA_GATEWAY:
+		if (mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+				       sizeof(struct in6_addr)) < 0)
 			return MNL_CB_ERROR;
-		}
 		break;
 	default:
 		break;
@@ -76,229 +2025,482 @@ static int data_attr_cb(const struct nlattr *attr, void *data)
 	return MNL_CB_OK;
 }
 
-static int data_cb(const struct nlmsghdr *nlh, void *data)
+/* returns 1 if the route is one of ours on rt, the kernel filters with
+ * strict checking but older kernels don't.
+ */
+static int nl_dump_route_parse(const struct nlmsghdr *nlh,
+			       const struct nl_rt *rt,
+			       struct nl_dump_route *r)
 {
-	struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
-	struct nlattr *tb[IFLA_MAX + 1] = {};
-	struct iface_llinfo *llinfo = data;
+	struct rtmsg *rtm = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[NL_RTA_MAX + 1] = {};
+	const struct nl_nh *nh = NULL;
 
-	/* TODO this will not available on bluetooth */
-	mnl_attr_parse(nlh, sizeof(*ifm), data_attr_cb, tb);
-	if (tb[IFLA_LINK])
-		llinfo->ifindex = mnl_attr_get_u32(tb[IFLA_LINK]);
+	if (nlh->nlmsg_type != RTM_NEWROUTE)
+		return 0;
 
-	if (tb[IFLA_ADDRESS]) {
-		llinfo->addr_len = mnl_attr_get_payload_len(tb[IFLA_ADDRESS]);
-		llinfo->addr = mzalloc(llinfo->addr_len);
-		if (!llinfo->addr)
-			return MNL_CB_ERROR;
+	if (mnl_attr_parse(nlh, sizeof(*rtm), route_attr_cb, tb) < 0)
+		return -1;
 
-		memcpy(llinfo->addr, mnl_attr_get_payload(tb[IFLA_ADDRESS]),
-		       llinfo->addr_len);
+	memset(r, 0, sizeof(*r));
+	r->table = tb[RTA_TABLE] ? mnl_attr_get_u32(tb[RTA_TABLE]) :
+		   rtm->rtm_table;
+	r->proto = rtm->rtm_protocol;
+	if (rtm->rtm_family != AF_INET6 || r->proto != rt->proto ||
+	    r->table != rt->table)
+		return 0;
+
+	if (tb[RTA_NH_ID]) {
+		r->nh_id = mnl_attr_get_u32(tb[RTA_NH_ID]);
+		nh = nl_nh_lookup_id(r->nh_id);
 	}
 
-	return MNL_CB_OK;
+	/* without nexthop compat mode only the id is dumped */
+	if (tb[RTA_OIF])
+		r->oif = mnl_attr_get_u32(tb[RTA_OIF]);
+	else if (nh)
+		r->oif = nh->ifindex;
+	if (r->oif != rt->ifindex)
+		return 0;
+
+	if (tb[RTA_GATEWAY])
+		memcpy(&r->via, mnl_attr_get_payload(tb[RTA_GATEWAY]),
+		       sizeof(r->via));
+	else if (nh)
+		r->via = nh->via;
+
+	r->dst.len = rtm->rtm_dst_len;
+	if (tb[RTA_DST])
+		memcpy(&r->dst.prefix, mnl_attr_get_payload(tb[RTA_DST]),
+		       sizeof(r->dst.prefix));
+
+	return 1;
 }
 
-int nl_get_llinfo(uint32_t ifindex, struct iface_llinfo *llinfo)
+static void nl_route_dump(const struct nl_rt *rt, mnl_cb_t data_cb,
+			  nl_cb_t cb, void *data)
 {
-	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
-	struct ifinfomsg *ifm;
 	struct nlmsghdr *nlh;
-	unsigned int seq;
-	int ret;
+	struct rtmsg *rtm;
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= RTM_GETLINK;
-	nlh->nlmsg_flags = NLM_F_REQUEST;
-	nlh->nlmsg_seq = seq = time(NULL);
-	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
-	ifm->ifi_family = AF_UNSPEC;
-	ifm->ifi_index = ifindex;
+	nlh = nl_batch_put_header(RTM_GETROUTE, NLM_F_DUMP);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_protocol = rt->proto;
+	rtm->rtm_table = rt->table < 256 ? rt->table : RT_TABLE_UNSPEC;
+	mnl_attr_put_u32(nlh, RTA_TABLE, rt->table);
+	mnl_attr_put_u32(nlh, RTA_OIF, rt->ifindex);
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_send");
-		return -1;
+	nl_batch_commit(nlh, NULL, data_cb, cb, data);
+}
+
+static int flush_route_msg_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct nl_dump_route *routes, r;
+	struct nl_flush *f = data;
+	int rc;
+
+	rc = nl_dump_route_parse(nlh, &f->rt, &r);
+	if (rc <= 0)
+		return rc == -1 ? MNL_CB_ERROR : MNL_CB_OK;
+
+	routes = realloc(f->routes, (f->routes_count + 1) * sizeof(*routes));
+	if (!routes)
+		return MNL_CB_ERROR;
+
+	f->routes = routes;
+	f->routes[f->routes_count++] = r;
+
+	return MNL_CB_OK;
+}
+
+static int nh_attr_cb(const struct nlattr *attr, void *data)
+{
+	int type = mnl_attr_get_type(attr);
+	const struct nlattr **tb = data;
+
+	if (mnl_attr_type_valid(attr, NHA_GATEWAY) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case NHA_ID:
+	case NHA_OIF:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
+			return MNL_CB_ERROR;
+		break;
+	case NHA_GATEWAY:
+		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0)
+			return MNL_CB_ERROR;
+		break;
+	default:
+		break;
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1)
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+/* returns 1 if the nexthop object is one of ours on rt */
+static int nl_dump_nh_parse(const struct nlmsghdr *nlh,
+			    const struct nl_rt *rt, struct nl_nh *nh)
+{
+	struct nhmsg *nhm = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[NHA_GATEWAY + 1] = {};
+
+	if (nlh->nlmsg_type != RTM_NEWNEXTHOP)
+		return 0;
+
+	if (mnl_attr_parse(nlh, sizeof(*nhm), nh_attr_cb, tb) < 0)
 		return -1;
 
-	return mnl_cb_run(buf, ret, seq, portid, data_cb, llinfo);
+	if (nhm->nh_protocol != rt->proto || !tb[NHA_ID] || !tb[NHA_OIF] ||
+	    mnl_attr_get_u32(tb[NHA_OIF]) != rt->ifindex)
+		return 0;
+
+	memset(nh, 0, sizeof(*nh));
+	nh->id = mnl_attr_get_u32(tb[NHA_ID]);
+	nh->ifindex = rt->ifindex;
+	if (tb[NHA_GATEWAY] &&
+	    mnl_attr_get_payload_len(tb[NHA_GATEWAY]) == sizeof(nh->via))
+		memcpy(&nh->via, mnl_attr_get_payload(tb[NHA_GATEWAY]),
+		       sizeof(nh->via));
+
+	return 1;
 }
 
-int nl_add_addr(uint32_t ifindex, const struct in6_addr *addr)
+static int flush_nh_msg_cb(const struct nlmsghdr *nlh, void *data)
 {
-	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
-	struct ifaddrmsg *ifm;
-	struct nlmsghdr *nlh;
-	unsigned int seq;
-	int ret;
+	struct nl_flush *f = data;
+	struct nl_nh nh;
+	uint32_t *ids;
+	int rc;
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= RTM_NEWADDR;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_ACK;
-	nlh->nlmsg_seq = seq = time(NULL);
-	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
+	rc = nl_dump_nh_parse(nlh, &f->rt, &nh);
+	if (rc <= 0)
+		return rc == -1 ? MNL_CB_ERROR : MNL_CB_OK;
 
-	ifm->ifa_index = ifindex;
-	ifm->ifa_family = AF_INET6;
-	ifm->ifa_prefixlen = 64;
-	ifm->ifa_flags = IFA_F_PERMANENT;
-	ifm->ifa_scope = RT_SCOPE_UNIVERSE;
+	ids = realloc(f->nh_ids, (f->nh_ids_count + 1) * sizeof(*ids));
+	if (!ids)
+		return MNL_CB_ERROR;
 
-	mnl_attr_put(nlh, IFA_ADDRESS, sizeof(*addr), addr);
+	f->nh_ids = ids;
+	f->nh_ids[f->nh_ids_count++] = nh.id;
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_send");
-		return -1;
+	return MNL_CB_OK;
+}
+
+static void nl_flush_nhs_done(int err, void *data)
+{
+	struct nl_flush *f = data;
+	struct nlmsghdr *nlh;
+	struct nhmsg *nhm;
+	int i, last = -1;
+
+	if (err) {
+		nl_flush_finish(err, f);
+		return;
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
-		return -1;
+	/* installed again while the flush was running */
+	for (i = 0; i < f->nh_ids_count; i++) {
+		if (nl_nh_lookup_id(f->nh_ids[i]))
+			f->nh_ids[i] = 0;
+		else
+			last = i;
+	}
+
+	if (last == -1) {
+		nl_flush_finish(0, f);
+		return;
 	}
 
-	return mnl_cb_run(buf, ret, seq, portid, NULL, NULL);
+	for (i = 0; i <= last; i++) {
+		if (!f->nh_ids[i])
+			continue;
+
+		nlh = nl_batch_put_header(RTM_DELNEXTHOP, 0);
+		nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(*nhm));
+		nhm->nh_family = AF_UNSPEC;
+		mnl_attr_put_u32(nlh, NHA_ID, f->nh_ids[i]);
+		/* acks are in order, the last one finishes the flush */
+		nl_batch_commit(nlh, NULL, NULL,
+				i == last ? nl_flush_finish : NULL,
+				i == last ? f : NULL);
+	}
 }
 
-int nl_add_route_via(uint32_t ifindex, const struct in6_addr *dst,
-		     const struct in6_addr *via)
+static void nl_nh_dump(const struct nl_rt *rt, mnl_cb_t data_cb, nl_cb_t cb,
+		       void *data)
 {
-	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
 	struct nlmsghdr *nlh;
+	struct nhmsg *nhm;
+
+	nlh = nl_batch_put_header(RTM_GETNEXTHOP, NLM_F_DUMP);
+	nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(*nhm));
+	nhm->nh_family = AF_INET6;
+	mnl_attr_put_u32(nlh, NHA_OIF, rt->ifindex);
+
+	nl_batch_commit(nlh, NULL, data_cb, cb, data);
+}
+
+static void nl_flush_routes_done(int err, void *data)
+{
+	struct nl_flush *f = data;
+	struct nl_dump_route *r;
+	int i, last = -1;
+	struct nlmsghdr *nlh;
+	struct nl_key key;
 	struct rtmsg *rtm;
-	unsigned int seq;
-	int ret;
+	nl_cb_t cb;
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= RTM_NEWROUTE;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_ACK;
-	nlh->nlmsg_seq = seq = time(NULL);
-	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+	if (err) {
+		nl_flush_finish(err, f);
+		return;
+	}
 
-	rtm->rtm_family = AF_INET6;
-	rtm->rtm_dst_len = 128;
-	rtm->rtm_src_len = 0;
-	rtm->rtm_tos = 0;
-	rtm->rtm_protocol = RTPROT_STATIC;
-	rtm->rtm_table = RT_TABLE_MAIN;
-	rtm->rtm_type = RTN_UNICAST;
-	/* is there any gateway? */
-	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
-	rtm->rtm_flags = 0;
+	/* installed again while the flush was running */
+	for (i = 0; i < f->routes_count; i++) {
+		r = &f->routes[i];
+		nl_key_init(&key, RTM_NEWROUTE, r->oif, &r->dst.prefix,
+			    r->dst.len, NULL);
+		if (nl_mirror_lookup_dst(&key))
+			r->oif = 0;
+		else
+			last = i;
+	}
 
-	mnl_attr_put(nlh, RTA_DST, sizeof(*dst), dst);
-	mnl_attr_put(nlh, RTA_GATEWAY, sizeof(*via), via);
-	mnl_attr_put_u32(nlh, RTA_OIF, ifindex);
+	for (i = 0; i <= last; i++) {
+		r = &f->routes[i];
+		if (!r->oif)
+			continue;
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_send");
-		return -1;
+		nlh = nl_batch_put_header(RTM_DELROUTE, 0);
+		rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+		rtm->rtm_family = AF_INET6;
+		rtm->rtm_dst_len = r->dst.len;
+		rtm->rtm_protocol = r->proto;
+		rtm->rtm_table = r->table < 256 ? r->table : RT_TABLE_UNSPEC;
+
+		mnl_attr_put_u32(nlh, RTA_TABLE, r->table);
+		if (r->dst.len)
+			mnl_attr_put(nlh, RTA_DST, sizeof(r->dst.prefix),
+				     &r->dst.prefix);
+		mnl_attr_put_u32(nlh, RTA_OIF, r->oif);
+
+		/* acks are in order, the last one finishes the flush */
+		cb = (i == last && !nh_supported) ? nl_flush_finish : NULL;
+		nl_batch_commit(nlh, NULL, NULL, cb, cb ? f : NULL);
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
+	/* routes first, a nexthop delete would take its routes along */
+	if (nh_supported)
+		nl_nh_dump(&f->rt, flush_nh_msg_cb, nl_flush_nhs_done, f);
+	else if (last == -1)
+		nl_flush_finish(0, f);
+}
+
+static void nl_flush_start(void *data)
+{
+	struct nl_flush *f = data;
+
+	nl_route_dump(&f->rt, flush_route_msg_cb, nl_flush_routes_done, f);
+}
+
+/* deletes everything with our table, protocol and interface by one dump
+ * and one batch of deletes, whatever a previous run left behind.
+ */
+int nl_flush_routes(uint32_t ifindex, nl_cb_t cb, void *data)
+{
+	struct nl_flush *f;
+
+	f = mzalloc(sizeof(*f));
+	if (!f)
+		return -1;
+
+	f->rt = *nl_rt_lookup(ifindex);
+	f->rt.ifindex = ifindex;
+	f->cb = cb;
+	f->data = data;
+
+	if (nl_dump_queue(nl_flush_start, f) == -1) {
+		free(f);
 		return -1;
 	}
 
-	return mnl_cb_run(buf, ret, seq, portid, NULL, NULL);
+	/* what is installed from now on survives the flush */
+	nl_mirror_flush(ifindex);
+	return 0;
 }
 
-int nl_add_route_default(uint32_t ifindex, const struct in6_addr *dst)
+static int reconcile_nh_msg_cb(const struct nlmsghdr *nlh, void *data)
 {
-	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
-	struct nlmsghdr *nlh;
-	struct rtmsg *rtm;
-	unsigned int seq;
-	int ret;
+	struct nl_rt *rt = data;
+	struct nl_nh tmp, *nh;
+	int rc;
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= RTM_NEWROUTE;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_ACK;
-	nlh->nlmsg_seq = seq = time(NULL);
-	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+	rc = nl_dump_nh_parse(nlh, rt, &tmp);
+	if (rc <= 0)
+		return rc == -1 ? MNL_CB_ERROR : MNL_CB_OK;
 
-	rtm->rtm_family = AF_INET6;
-	rtm->rtm_dst_len = 0;
-	rtm->rtm_src_len = 0;
-	rtm->rtm_tos = 0;
-	rtm->rtm_protocol = RTPROT_STATIC;
-	rtm->rtm_table = RT_TABLE_MAIN;
-	rtm->rtm_type = RTN_UNICAST;
-	/* is there any gateway? */
-	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
-	rtm->rtm_flags = 0;
+	if (nl_nh_lookup_id(tmp.id))
+		return MNL_CB_OK;
 
-	mnl_attr_put(nlh, RTA_GATEWAY, sizeof(*dst), dst);
-	mnl_attr_put_u32(nlh, RTA_OIF, ifindex);
+	nh = mzalloc(sizeof(*nh));
+	if (!nh)
+		return MNL_CB_ERROR;
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_send");
-		return -1;
+	*nh = tmp;
+	DL_APPEND(nhs.head, &nh->list);
+	return MNL_CB_OK;
+}
+
+/* adopt the route into the mirror, a DAO or DAO-ACK makes it ours again */
+static int reconcile_route_msg_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct nl_rt *rt = data;
+	struct nl_dump_route r;
+	struct nl_nh *nh = NULL;
+	struct nl_mirror *m;
+	struct nl_key key;
+	int rc;
+
+	rc = nl_dump_route_parse(nlh, rt, &r);
+	if (rc <= 0)
+		return rc == -1 ? MNL_CB_ERROR : MNL_CB_OK;
+
+	nl_key_init(&key, RTM_NEWROUTE, r.oif, &r.dst.prefix, r.dst.len,
+		    &r.via);
+	if (nl_mirror_lookup_dst(&key))
+		return MNL_CB_OK;
+
+	if (r.nh_id) {
+		nh = nl_nh_lookup_id(r.nh_id);
+		if (nh) {
+			nh->refcnt++;
+			nh->upstream = !r.dst.len;
+		}
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
-		return -1;
+	if (nl_mirror_insert(&key, nh) == -1) {
+		if (nh)
+			nh->refcnt--;
+		return MNL_CB_ERROR;
 	}
 
-	return mnl_cb_run(buf, ret, seq, portid, NULL, NULL);
+	m = nl_mirror_lookup(&key);
+	m->stale = true;
+
+	if (rt->route_cb)
+		rt->route_cb(r.oif, &r.dst, &r.via, false, rt->route_data);
+
+	return MNL_CB_OK;
 }
 
-int nl_del_route_via(uint32_t ifindex, const struct in6_prefix *dst,
-		     struct in6_addr *via)
+static void nl_reconcile_routes_done(int err, void *data)
 {
-	unsigned char buf[MNL_SOCKET_BUFFER_SIZE];
-	struct nlmsghdr *nlh;
-	struct rtmsg *rtm;
-	unsigned int seq;
-	int ret;
+	struct nl_rt *rt = data;
+	struct list *e, *tmp;
+	struct nl_nh *nh;
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= RTM_DELROUTE;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-	nlh->nlmsg_seq = seq = time(NULL);
-	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtm));
+	/* nexthop objects without a route are of no use */
+	DL_FOREACH_SAFE(nhs.head, e, tmp) {
+		nh = container_of(e, struct nl_nh, list);
+		if (nh->ifindex == rt->ifindex && !nh->refcnt) {
+			nh->refcnt = 1;
+			nl_nh_put(nh);
+		}
+	}
 
-	rtm->rtm_family = AF_INET6;
-	rtm->rtm_dst_len = dst->len;
-	rtm->rtm_src_len = 0;
-	rtm->rtm_tos = 0;
-	rtm->rtm_table = RT_TABLE_MAIN;
-	/* is there any gateway? */
-	rtm->rtm_flags = 0;
+	nl_dump_done();
+	if (err)
+		return;
 
-	mnl_attr_put(nlh, RTA_DST, sizeof(dst->prefix), &dst->prefix);
-	if (via)
-		mnl_attr_put(nlh, RTA_GATEWAY, sizeof(*via), via);
-	mnl_attr_put_u32(nlh, RTA_OIF, ifindex);
+	ev_timer_start(nl_loop, &rt->stale_w);
+}
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_send");
-		return -1;
-	}
+static void nl_reconcile_nhs_done(int err, void *data)
+{
+	struct nl_rt *rt = data;
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
-		return -1;
+	/* the routes are looked up by nexthop id */
+	nl_route_dump(rt, reconcile_route_msg_cb, nl_reconcile_routes_done, rt);
+}
+
+static void nl_reconcile_start(void *data)
+{
+	struct nl_rt *rt = data;
+
+	if (nh_supported) {
+		nl_nh_dump(rt, reconcile_nh_msg_cb, nl_reconcile_nhs_done, rt);
+		return;
 	}
 
-	return mnl_cb_run(buf, ret, seq, portid, NULL, NULL);
+	nl_route_dump(rt, reconcile_route_msg_cb, nl_reconcile_routes_done, rt);
 }
 
-/* TODO THIS WILL ADD A STATEFUL COMPRESSION ENTRY INTO THE KERNEL
- * BUT I WANT A NETLINK API BEFORE WE IMPLEMENT IT. IT MAKES SENSE
- * WE ONLY USE STATELESS TO CONFIGURE THE NETWORK.
+/* whatever a DAO or DAO-ACK does not install again within grace seconds
+ * gets deleted. Routes which match the kernel are then never sent twice,
+ * there is no flap and no EEXIST on restart.
  */
-#if 0
-int nl_stateful_add_compression_entry(uint32_t ifindex, const struct in6_prefix *pfx)
+static void nl_stale_cb(EV_P_ ev_timer *w, int revents)
+{
+	struct nl_rt *rt = container_of(w, struct nl_rt, stale_w);
+	const struct nl_mirror *m;
+	struct nl_key *keys;
+	struct list *e;
+	int i, n = 0;
+
+	for (i = 0; i < NL_MIRROR_BUCKETS; i++) {
+		DL_FOREACH(mirror[i].head, e) {
+			m = container_of(e, struct nl_mirror, list);
+			if (m->stale && m->key.ifindex == rt->ifindex)
+				n++;
+		}
+	}
+
+	if (!n)
+		return;
+
+	keys = mzalloc(n * sizeof(*keys));
+	if (!keys) {
+		flog(LOG_ERR, "no memory for stale routes on %u", rt->ifindex);
+		return;
+	}
+
+	/* deleting runs completions which change the mirror, walk first */
+	n = 0;
+	for (i = 0; i < NL_MIRROR_BUCKETS; i++) {
+		DL_FOREACH(mirror[i].head, e) {
+			m = container_of(e, struct nl_mirror, list);
+			if (m->stale && m->key.ifindex == rt->ifindex)
+				keys[n++] = m->key;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (rt->route_cb)
+			rt->route_cb(keys[i].ifindex, &keys[i].dst,
+				     &keys[i].via, true, rt->route_data);
+
+		nl_del_mirrored(&keys[i], NULL, NULL);
+	}
+
+	free(keys);
+	flog(LOG_INFO, "%d stale routes on %u removed", n, rt->ifindex);
+}
+
+int nl_reconcile_routes(uint32_t ifindex, ev_tstamp grace, nl_route_cb_t cb,
+			void *data)
 {
+	struct nl_rt *rt = (struct nl_rt *)nl_rt_lookup(ifindex);
 
+	/* the table must be known */
+	if (rt == &rt_default)
+		return -1;
+
+	rt->route_cb = cb;
+	rt->route_data = data;
+	ev_timer_init(&rt->stale_w, nl_stale_cb, grace, 0);
+
+	return nl_dump_queue(nl_reconcile_start, rt);
 }
-#endif
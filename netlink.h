@@ -15,14 +15,65 @@
 
 #include "config.h"
 
-int nl_add_addr(uint32_t ifindex, const struct in6_addr *addr);
-int nl_get_llinfo(uint32_t ifindex, struct iface_llinfo *llinfo);
+/* most segments of a source route */
+#define NL_SRH_SEGS_MAX	32
+
+/* called when the kernel answered a request, err is zero or a negative
+ * errno. If there is nothing to change the callback is called right away.
+ */
+typedef void (*nl_cb_t)(int err, void *data);
+
+/* cached state of a link, kept current by the netlink monitor */
+struct nl_link {
+	uint32_t ifindex;
+	char ifname[IFNAMSIZ];
+	struct iface_llinfo llinfo;
+
+	/* IPv6 addresses in ascending order */
+	struct in6_addr *addrs;
+	int addrs_count;
+
+	struct list list;
+};
+
+/* called for every change of a cached link */
+typedef void (*nl_link_cb_t)(const struct nl_link *link, void *data);
+
+/* called for every state change of a kernel neighbor, state is NUD_* */
+typedef void (*nl_neigh_cb_t)(uint32_t ifindex, const struct in6_addr *addr,
+			      uint16_t state, void *data);
+
+/* called for a route of a previous run when it's found at startup, and
+ * with expired set when it was not installed again in time.
+ */
+typedef void (*nl_route_cb_t)(uint32_t ifindex, const struct in6_prefix *dst,
+			      const struct in6_addr *via, bool expired,
+			      void *data);
+
+bool nl_has_addr(uint32_t ifindex, const struct in6_addr *addr);
+int nl_add_addr(uint32_t ifindex, const struct in6_addr *addr, nl_cb_t cb,
+		void *data);
 int nl_add_route_via(uint32_t ifindex, const struct in6_addr *route,
-		     const struct in6_addr *via);
-int nl_add_route_default(uint32_t ifindex, const struct in6_addr *via);
+		     const struct in6_addr *via, nl_cb_t cb, void *data);
+int nl_add_route_default(uint32_t ifindex, const struct in6_addr *via,
+			 nl_cb_t cb, void *data);
+int nl_add_route_srh(uint32_t ifindex, const struct in6_addr *dst,
+		     const struct in6_addr *segs, int segs_count,
+		     nl_cb_t cb, void *data);
 int nl_del_route_via(uint32_t ifindex, const struct in6_prefix *dst,
-		     struct in6_addr *via);
-int netlink_open(void);
+		     struct in6_addr *via, nl_cb_t cb, void *data);
+int nl_del_route(uint32_t ifindex, const struct in6_prefix *dst, nl_cb_t cb,
+		 void *data);
+int nl_set_route_table(uint32_t ifindex, uint32_t table, uint8_t proto);
+void nl_unset_route_table(uint32_t ifindex);
+int nl_flush_routes(uint32_t ifindex, nl_cb_t cb, void *data);
+int nl_reconcile_routes(uint32_t ifindex, ev_tstamp grace, nl_route_cb_t cb,
+			void *data);
+const struct nl_link *nl_link_lookup(const char *ifname);
+int nl_links_open(nl_link_cb_t cb, void *data);
+void nl_neighs_monitor(nl_neigh_cb_t cb, void *data);
+int netlink_open(struct ev_loop *loop);
+int netlink_sync(void);
 void netlink_close(void);
 
 #endif /* __RPLD_NETLINK_H__ */
@@ -0,0 +1,196 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <string.h>
+
+#include "config.h"
+#include "rpl.h"
+#include "of.h"
+
+/* RFC 6552, step of rank taken from the link etx */
+#define OF0_MIN_STEP_OF_RANK	1
+#define OF0_MAX_STEP_OF_RANK	9
+#define OF0_RANK_FACTOR		1
+#define OF0_RANK_STRETCH	0
+
+/* RFC 6719, all in etx units */
+#define MRHOF_MAX_LINK_METRIC		(4 * RPL_ETX_DIVISOR)
+#define MRHOF_MAX_PATH_COST		0x8000
+#define MRHOF_PARENT_SWITCH_THRESHOLD	(3 * RPL_ETX_DIVISOR / 2)
+#define MRHOF_INFINITE_COST		UINT32_MAX
+
+static uint16_t rank_add(uint16_t rank, uint32_t increase)
+{
+	if (rank == RPL_INFINITE_RANK ||
+	    rank + increase >= RPL_INFINITE_RANK)
+		return RPL_INFINITE_RANK;
+
+	return rank + increase;
+}
+
+static uint16_t of0_rank(const struct dag *dag, const struct peer *peer)
+{
+	int step;
+
+	/* a perfect link is one step, like Contiki does */
+	step = (3 * peer->neigh->etx) / RPL_ETX_DIVISOR - 2;
+	if (step < OF0_MIN_STEP_OF_RANK)
+		step = OF0_MIN_STEP_OF_RANK;
+	if (step > OF0_MAX_STEP_OF_RANK)
+		step = OF0_MAX_STEP_OF_RANK;
+
+	return rank_add(peer->rank,
+			(OF0_RANK_FACTOR * step + OF0_RANK_STRETCH) *
+			dag->min_hop_rank_inc);
+}
+
+/* a whole DAGRank better, an equal one keeps the parent */
+static bool of0_better(const struct dag *dag, const struct peer *parent,
+		       const struct peer *peer)
+{
+	return dag_rank(dag, of0_rank(dag, peer)) <
+	       dag_rank(dag, of0_rank(dag, parent));
+}
+
+static uint32_t of0_cost(const struct dag *dag, const struct peer *peer)
+{
+	return of0_rank(dag, peer);
+}
+
+/* the expected transmissions of the link, each takes our latency */
+static uint32_t mrhof_link_latency(const struct dag *dag,
+				   const struct peer *peer)
+{
+	return (uint64_t)peer->neigh->etx * dag->iface->latency /
+	       RPL_ETX_DIVISOR;
+}
+
+/*
+ * The path cost by the metric of the root, RFC 6719 3.1. Without a
+ * metric container the rank of the peer is its path etx.
+ */
+static uint32_t mrhof_path_cost(const struct dag *dag,
+				const struct peer *peer)
+{
+	uint64_t cost;
+
+	if (peer->rank == RPL_INFINITE_RANK ||
+	    peer->neigh->etx > MRHOF_MAX_LINK_METRIC)
+		return MRHOF_INFINITE_COST;
+
+	switch (dag->metric) {
+	case RPL_MC_HC:
+		if (!peer->mc.present)
+			return MRHOF_INFINITE_COST;
+
+		return peer->mc.hops + 1;
+	case RPL_MC_LATENCY:
+		if (!peer->mc.present)
+			return MRHOF_INFINITE_COST;
+
+		cost = (uint64_t)peer->mc.latency +
+		       mrhof_link_latency(dag, peer);
+		return cost < MRHOF_INFINITE_COST ? cost : MRHOF_INFINITE_COST;
+	default:
+		if (peer->mc.present)
+			return peer->mc.etx + peer->neigh->etx;
+
+		return peer->rank + peer->neigh->etx;
+	}
+}
+
+static uint16_t mrhof_rank(const struct dag *dag, const struct peer *peer)
+{
+	uint32_t cost = mrhof_path_cost(dag, peer);
+	uint16_t min;
+
+	if (cost == MRHOF_INFINITE_COST)
+		return RPL_INFINITE_RANK;
+
+	/* at least one hop more than the parent */
+	min = rank_add(peer->rank, dag->min_hop_rank_inc);
+
+	/* only an etx path cost is a rank, RFC 6719 3.3 */
+	if (dag->metric == RPL_MC_HC || dag->metric == RPL_MC_LATENCY)
+		return min;
+
+	if (cost >= MRHOF_MAX_PATH_COST)
+		return RPL_INFINITE_RANK;
+
+	return cost > min ? cost : min;
+}
+
+static uint32_t mrhof_threshold(const struct dag *dag)
+{
+	switch (dag->metric) {
+	case RPL_MC_HC:
+		return 0;
+	case RPL_MC_LATENCY:
+		/* half a transmission of ours */
+		return dag->iface->latency / 2;
+	default:
+		return MRHOF_PARENT_SWITCH_THRESHOLD;
+	}
+}
+
+static bool mrhof_better(const struct dag *dag, const struct peer *parent,
+			 const struct peer *peer)
+{
+	uint32_t cost = mrhof_path_cost(dag, peer);
+
+	if (cost == MRHOF_INFINITE_COST)
+		return false;
+
+	return (uint64_t)cost + mrhof_threshold(dag) <
+	       mrhof_path_cost(dag, parent);
+}
+
+static const struct of ofs[] = {
+	{
+		.name = "of0",
+		.ocp = RPL_OCP_OF0,
+		.rank = of0_rank,
+		.cost = of0_cost,
+		.better = of0_better,
+	},
+	{
+		.name = "mrhof",
+		.ocp = RPL_OCP_MRHOF,
+		.rank = mrhof_rank,
+		.cost = mrhof_path_cost,
+		.better = mrhof_better,
+	},
+};
+
+const struct of *of_lookup(uint16_t ocp)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(ofs) / sizeof(ofs[0]); i++) {
+		if (ofs[i].ocp == ocp)
+			return &ofs[i];
+	}
+
+	return NULL;
+}
+
+const struct of *of_lookup_name(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(ofs) / sizeof(ofs[0]); i++) {
+		if (!strcmp(ofs[i].name, name))
+			return &ofs[i];
+	}
+
+	return NULL;
+}
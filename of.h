@@ -0,0 +1,54 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_OF_H__
+#define __RPLD_OF_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dag.h"
+
+#define RPL_INFINITE_RANK	0xffff
+#define RPL_DEFAULT_MIN_HOP_RANK_INCREASE	256
+
+/* objective code points */
+#define RPL_OCP_OF0		0
+#define RPL_OCP_MRHOF		1
+
+/* link etx is fixed point, RFC 6551 */
+#define RPL_ETX_DIVISOR		128
+/* until the link is measured */
+#define RPL_ETX_INIT		(2 * RPL_ETX_DIVISOR)
+
+struct of {
+	const char *name;
+	uint16_t ocp;
+
+	/* our rank with peer as parent, RPL_INFINITE_RANK if not usable */
+	uint16_t (*rank)(const struct dag *dag, const struct peer *peer);
+	/* orders the candidates, the smaller the better */
+	uint32_t (*cost)(const struct dag *dag, const struct peer *peer);
+	/* if peer is enough better than parent to switch, hysteresis */
+	bool (*better)(const struct dag *dag, const struct peer *parent,
+		       const struct peer *peer);
+};
+
+const struct of *of_lookup(uint16_t ocp);
+const struct of *of_lookup_name(const char *name);
+
+static inline uint16_t dag_rank(const struct dag *dag, uint16_t rank)
+{
+	return rank / dag->min_hop_rank_inc;
+}
+
+#endif /* __RPLD_OF_H__ */
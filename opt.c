@@ -0,0 +1,62 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "opt.h"
+#include "rpl.h"
+
+/*
+ * Walks the options of a message once, types is indexed by the option
+ * type. Padding and types without a handler are skipped, RFC 6550 6.7.1
+ * says unknown ones are ignored. -1 if an option doesn't fit into the
+ * message or a handler refuses it.
+ */
+int opt_parse(const void *buf, size_t len, const struct opt_type *types,
+	      void *data)
+{
+	const unsigned char *p = buf;
+	const struct opt_type *t;
+	size_t olen;
+
+	while (len > 0) {
+		if (p[0] == RPL_OPT_PAD0) {
+			p++;
+			len--;
+			continue;
+		}
+
+		if (len < sizeof(struct nd_rpl_opt))
+			return -1;
+
+		olen = sizeof(struct nd_rpl_opt) + p[1];
+		if (olen > len)
+			return -1;
+
+		if (p[0] < OPT_TYPES) {
+			t = &types[p[0]];
+			if (t->cb) {
+				if (olen < t->min_len)
+					return -1;
+
+				if (t->cb(p, olen, data) == -1)
+					return -1;
+			}
+		}
+
+		p += olen;
+		len -= olen;
+	}
+
+	return 0;
+}
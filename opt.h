@@ -0,0 +1,37 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_OPT_H__
+#define __RPLD_OPT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* highest option type we handle is the lowpan context */
+#define OPT_TYPES		0x23
+
+/*
+ * Handler of an option type, gets the whole option with type and length
+ * which is at least min_len long and inside the message. -1 makes the
+ * message malformed.
+ */
+typedef int (*opt_cb_t)(const void *opt, size_t len, void *data);
+
+struct opt_type {
+	size_t min_len;
+	opt_cb_t cb;
+};
+
+int opt_parse(const void *buf, size_t len, const struct opt_type *types,
+	      void *data);
+
+#endif /* __RPLD_OPT_H__ */
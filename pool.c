@@ -0,0 +1,125 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "log.h"
+#include "pool.h"
+
+struct pool_slab {
+	struct pool_slab *next;
+	alignas(max_align_t) unsigned char objs[];
+};
+
+/* free objects link through their first bytes */
+struct pool_obj {
+	struct pool_obj *next;
+};
+
+/* every pool which was ever used, for stats */
+static struct list_head pools;
+
+static size_t pool_obj_size(const struct pool *pool)
+{
+	size_t size = pool->size;
+
+	if (size < sizeof(struct pool_obj))
+		size = sizeof(struct pool_obj);
+
+	return (size + alignof(max_align_t) - 1) &
+	       ~(alignof(max_align_t) - 1);
+}
+
+static int pool_grow(struct pool *pool, unsigned int n)
+{
+	size_t size = pool_obj_size(pool);
+	struct pool_slab *slab;
+	struct pool_obj *obj;
+	unsigned int i;
+
+	slab = malloc(sizeof(*slab) + n * size);
+	if (!slab)
+		return -1;
+
+	if (!pool->slabs)
+		DL_APPEND(pools.head, &pool->list);
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	/* put them in address order on the free list */
+	for (i = n; i > 0; i--) {
+		obj = (struct pool_obj *)&slab->objs[(i - 1) * size];
+		obj->next = pool->free;
+		pool->free = obj;
+	}
+
+	pool->total += n;
+	return 0;
+}
+
+int pool_prealloc(struct pool *pool, unsigned int n)
+{
+	if (n <= pool->total - pool->used)
+		return 0;
+
+	return pool_grow(pool, n - (pool->total - pool->used));
+}
+
+void *pool_alloc(struct pool *pool)
+{
+	struct pool_obj *obj;
+
+	if (!pool->free && pool_grow(pool, POOL_SLAB_OBJS) == -1) {
+		pool->fails++;
+		return NULL;
+	}
+
+	obj = pool->free;
+	pool->free = obj->next;
+
+	pool->used++;
+	if (pool->used > pool->peak)
+		pool->peak = pool->used;
+
+	memset(obj, 0, pool->size);
+	return obj;
+}
+
+void pool_free(struct pool *pool, void *obj)
+{
+	struct pool_obj *o = obj;
+
+	if (!obj)
+		return;
+
+	o->next = pool->free;
+	pool->free = o;
+	pool->used--;
+}
+
+void pool_stats(void)
+{
+	struct pool *pool;
+	struct list *p;
+
+	DL_FOREACH(pools.head, p) {
+		pool = container_of(p, struct pool, list);
+
+		flog(LOG_INFO, "pool %s: %u/%u used, peak %u, %zu bytes, %u failed",
+		     pool->name, pool->used, pool->total, pool->peak,
+		     pool->total * pool_obj_size(pool), pool->fails);
+	}
+}
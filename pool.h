@@ -0,0 +1,55 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_POOL_H__
+#define __RPLD_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+/* objects per slab if the pool grows on demand */
+#define POOL_SLAB_OBJS	32
+
+struct pool_slab;
+
+/*
+ * Fixed size object pool. Memory is taken from the general allocator in
+ * slabs of objects and never given back, freed objects go on a free list
+ * and are handed out again by the next alloc.
+ */
+struct pool {
+	const char *name;
+	size_t size;
+
+	struct pool_slab *slabs;
+	void *free;
+
+	/* objects in slabs, in use and the most ever in use */
+	unsigned int total;
+	unsigned int used;
+	unsigned int peak;
+	/* allocs which the general allocator could not serve */
+	unsigned int fails;
+
+	struct list list;
+};
+
+#define POOL_INIT(_name, _type) { .name = (_name), .size = sizeof(_type) }
+
+int pool_prealloc(struct pool *pool, unsigned int n);
+void *pool_alloc(struct pool *pool);
+void pool_free(struct pool *pool, void *obj);
+void pool_stats(void);
+
+#endif /* __RPLD_POOL_H__ */
@@ -15,23 +15,223 @@
 
 #include <linux/ipv6.h>
 #include <netinet/icmp6.h>
+#include <stddef.h>
 
 #include "process.h"
 #include "netlink.h"
 #include "send.h"
 #include "dag.h"
 #include "log.h"
+#include "opt.h"
 #include "rpl.h"
 
+/* validated views of the dio options we know */
+struct dio_opts {
+	const struct rpl_dio_destprefix *destprefix;
+	const struct rpl_dio_config *config;
+	const struct rpl_dio_lowpan_ctx *ctx;
+	struct dag_metrics mc;
+};
+
+static int dio_opt_destprefix(const void *opt, size_t len, void *data)
+{
+	const struct rpl_dio_destprefix *diodp = opt;
+	struct dio_opts *o = data;
+
+	if (diodp->rpl_dio_prefixlen > 128 ||
+	    len < offsetof(struct rpl_dio_destprefix, rpl_dio_prefix) +
+		  bits_to_bytes(diodp->rpl_dio_prefixlen))
+		return -1;
+
+	o->destprefix = diodp;
+	return 0;
+}
+
+static int dio_opt_config(const void *opt, size_t len, void *data)
+{
+	struct dio_opts *o = data;
+
+	o->config = opt;
+	return 0;
+}
+
+/* -1 if the body is too short for the object */
+static int dio_mc_object(const struct rpl_mc_object *obj,
+			 struct dag_metrics *mc)
+{
+	uint32_t latency;
+	uint16_t etx;
+
+	switch (obj->rpl_mc_type) {
+	case RPL_MC_HC:
+		if (obj->rpl_mc_len < RPL_MC_HC_LEN)
+			return -1;
+
+		mc->hops = obj->rpl_mc_data[1];
+		break;
+	case RPL_MC_LATENCY:
+		if (obj->rpl_mc_len < RPL_MC_LATENCY_LEN)
+			return -1;
+
+		memcpy(&latency, obj->rpl_mc_data, sizeof(latency));
+		mc->latency = ntohl(latency);
+		break;
+	case RPL_MC_ETX:
+		if (obj->rpl_mc_len < RPL_MC_ETX_LEN)
+			return -1;
+
+		memcpy(&etx, obj->rpl_mc_data, sizeof(etx));
+		mc->etx = ntohs(etx);
+		break;
+	case RPL_MC_NE:
+		if (obj->rpl_mc_len < RPL_MC_NE_LEN)
+			return -1;
+
+		mc->energy = RPL_MC_NE_T(obj->rpl_mc_data[0]);
+		return 0;
+	default:
+		return 0;
+	}
+
+	/* a path metric, the first one is to optimize */
+	if (mc->metric == RPL_MC_NONE)
+		mc->metric = obj->rpl_mc_type;
+
+	return 0;
+}
+
+/* RFC 6551, constraints and unknown objects are skipped */
+static int dio_opt_metrics(const void *opt, size_t len, void *data)
+{
+	const struct rpl_mc_object *obj;
+	const unsigned char *p = opt;
+	struct dio_opts *o = data;
+	size_t off;
+
+	memset(&o->mc, 0, sizeof(o->mc));
+	for (off = sizeof(struct nd_rpl_opt); off < len;
+	     off += sizeof(*obj) + obj->rpl_mc_len) {
+		obj = (const struct rpl_mc_object *)(p + off);
+		if (len - off < sizeof(*obj) ||
+		    len - off - sizeof(*obj) < obj->rpl_mc_len)
+			return -1;
+
+		if (obj->rpl_mc_flags & RPL_MC_C)
+			continue;
+
+		if (dio_mc_object(obj, &o->mc) == -1)
+			return -1;
+	}
+
+	o->mc.present = true;
+	return 0;
+}
+
+static int dio_opt_lowpan_ctx(const void *opt, size_t len, void *data)
+{
+	const struct rpl_dio_lowpan_ctx *ctx = opt;
+	struct dio_opts *o = data;
+
+	if (ctx->rpl_dio_ctxlen > 128 ||
+	    len < offsetof(struct rpl_dio_lowpan_ctx, rpl_dio_prefix) +
+		  bits_to_bytes(ctx->rpl_dio_ctxlen))
+		return -1;
+
+	o->ctx = ctx;
+	return 0;
+}
+
+static const struct opt_type dio_opt_types[OPT_TYPES] = {
+	[RPL_DIO_ROUTINGINFO] = {
+		.min_len = offsetof(struct rpl_dio_destprefix, rpl_dio_prefix),
+		.cb = dio_opt_destprefix,
+	},
+	[RPL_DIO_METRICS] = {
+		.min_len = sizeof(struct nd_rpl_opt),
+		.cb = dio_opt_metrics,
+	},
+	[RPL_DIO_CONFIG] = {
+		.min_len = sizeof(struct rpl_dio_config),
+		.cb = dio_opt_config,
+	},
+	[RPL_DIO_LOWPAN_CTX] = {
+		.min_len = offsetof(struct rpl_dio_lowpan_ctx, rpl_dio_prefix),
+		.cb = dio_opt_lowpan_ctx,
+	},
+};
+
+/* another dag of the iface announces cid */
+static bool lowpan_ctx_used(const struct iface *iface,
+			    const struct dag *dag, uint8_t cid)
+{
+	const struct list *r, *d;
+	const struct rpl *rpl;
+	const struct dag *tmp;
+
+	DL_FOREACH(iface->rpls.head, r) {
+		rpl = container_of(r, struct rpl, list);
+		DL_FOREACH(rpl->dags.head, d) {
+			tmp = container_of(d, struct dag, list);
+			if (tmp != dag && tmp->has_ctx && tmp->ctx_cid == cid)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* use the context the root decided for the dag prefix */
+static void process_dio_lowpan_ctx(struct iface *iface, struct dag *dag,
+				   const struct rpl_dio_lowpan_ctx *ctx)
+{
+	const struct lowpan_ctx *cur;
+	struct in6_prefix pfx = {};
+	uint8_t cid;
+
+	/* only the one of our dag prefix, nothing else is trusted */
+	pfx.len = ctx->rpl_dio_ctxlen;
+	memcpy(&pfx.prefix, &ctx->rpl_dio_prefix, bits_to_bytes(pfx.len));
+	if (pfx.len != dag->dest.len ||
+	    !in6_prefix_contains(&dag->dest, &pfx.prefix))
+		return;
+
+	cid = ctx->rpl_dio_flags & RPL_DIO_LOWPAN_CTX_CID_MASK;
+	if (dag->has_ctx && dag->ctx_cid == cid)
+		return;
+
+	/* two prefixes behind one cid would decompress wrong */
+	cur = &iface->ctxs[cid];
+	if (cur->active && (cur->pfx.len != dag->dest.len ||
+			    memcmp(&cur->pfx.prefix, &dag->dest.prefix,
+				   sizeof(cur->pfx.prefix)))) {
+		flog(LOG_WARNING, "%s context %u is in use for another prefix",
+		     iface->ifname, cid);
+		return;
+	}
+
+	if (lowpan_ctx_set(iface, cid, &dag->dest,
+			   ctx->rpl_dio_flags & RPL_DIO_LOWPAN_CTX_C) == -1)
+		return;
+
+	/* the root moved our prefix, the old cid is stale */
+	if (dag->has_ctx && !lowpan_ctx_used(iface, dag, dag->ctx_cid))
+		lowpan_ctx_clear(iface, dag->ctx_cid);
+
+	dag->has_ctx = true;
+	dag->ctx_cid = cid;
+	dag_dio_invalidate(dag);
+}
+
 static void process_dio(int sock, struct iface *iface, const void *msg,
 			size_t len, struct sockaddr_in6 *addr)
 {
 	const struct nd_rpl_dio *dio = msg;
-	const struct rpl_dio_destprefix *diodp;
 	char addr_str[INET6_ADDRSTRLEN];
-	struct in6_prefix pfx;
+	struct in6_prefix pfx = {};
+	struct dio_opts o = {};
 	struct dag *dag;
 	uint16_t rank;
+	bool changed;
 
 	if (len < sizeof(*dio)) {
 		flog(LOG_INFO, "dio length mismatch, drop");
@@ -42,81 +242,227 @@ static void process_dio(int sock, struct iface *iface, const void *msg,
 	addrtostr(&addr->sin6_addr, addr_str, sizeof(addr_str));
 	flog(LOG_INFO, "received dio %s", addr_str);
 
+	if (opt_parse((const unsigned char *)msg + sizeof(*dio), len,
+		      dio_opt_types, &o) == -1) {
+		flog(LOG_INFO, "dio options malformed, drop");
+		return;
+	}
+
+	neigh_rx_dio(iface->ifindex, &addr->sin6_addr);
+
 	dag = dag_lookup(iface, dio->rpl_instanceid,
 			 &dio->rpl_dagid);
 	if (dag) {
-		if (dag->my_rank == 1)
-			return;
-	} else {
-		diodp = (struct rpl_dio_destprefix *)
-			 (((unsigned char *)msg) + sizeof(*dio));
+		/* a node of an old version has to hear about ours */
+		if (iface->dodag_root) {
+			if (dio->rpl_version == dag->version)
+				trickle_consistent(&dag->trickle);
+			else
+				trickle_inconsistent(&dag->trickle);
 
-		if (len < sizeof(*diodp) - 16) {
-			flog(LOG_INFO, "diodp length mismatch, drop");
 			return;
 		}
-		len -= sizeof(*diodp) - 16;
 
-		if (diodp->rpl_dio_type != 0x3) {
-			flog(LOG_INFO, "we assume diodp - not supported, drop");
+		if (!dag_check_version(dag, dio->rpl_version)) {
+			flog(LOG_INFO, "dio of old dag version, drop");
+			trickle_inconsistent(&dag->trickle);
 			return;
 		}
-
-		if (len < bits_to_bytes(diodp->rpl_dio_prefixlen)) {
-			flog(LOG_INFO, "diodp prefix length mismatch, drop");
+	} else {
+		if (!o.destprefix) {
+			flog(LOG_INFO, "dio without dest prefix, drop");
 			return;
 		}
-		len -= bits_to_bytes(diodp->rpl_dio_prefixlen);
 
-		pfx.len = diodp->rpl_dio_prefixlen;
-		memcpy(&pfx.prefix, &diodp->rpl_dio_prefix,
+		pfx.len = o.destprefix->rpl_dio_prefixlen;
+		memcpy(&pfx.prefix, &o.destprefix->rpl_dio_prefix,
 		       bits_to_bytes(pfx.len));
 
 		flog(LOG_INFO, "received but no dag found %s", addr_str);
 		dag = dag_create(iface, dio->rpl_instanceid,
-				 &dio->rpl_dagid, DEFAULT_TICKLE_T,
-				 UINT16_MAX, dio->rpl_version, &pfx);
+				 &dio->rpl_dagid, UINT16_MAX, dio->rpl_version,
+				 &pfx);
 		if (!dag)
 			return;
 
+		dag->mop = RPL_DIO_MOP(dio->rpl_mopprf);
+		trickle_start(&dag->trickle);
 		addrtostr(&dio->rpl_dagid, addr_str, sizeof(addr_str));
 		flog(LOG_INFO, "created dag %s", addr_str);
 	}
 
 	flog(LOG_INFO, "process dio %s", addr_str);
 
-	rank = ntohs(dio->rpl_dagrank);
-	if (!dag->parent) {
-		dag->parent = dag_peer_create(&addr->sin6_addr);
-		if (!dag->parent)
-			return;
+	if (o.ctx)
+		process_dio_lowpan_ctx(iface, dag, o.ctx);
+
+	/* before the candidates get ranked with it */
+	if (o.config)
+		dag_process_config(dag, o.config);
+
+	/* the metric is the root's decision as the config is */
+	if (o.mc.present && o.mc.metric != RPL_MC_NONE &&
+	    o.mc.metric != dag->metric) {
+		dag->metric = o.mc.metric;
+		dag_dio_invalidate(dag);
 	}
 
-	if (rank > dag->parent->rank)
+	rank = ntohs(dio->rpl_dagrank);
+	if (dag_update_candidate(dag, &addr->sin6_addr, rank,
+				 o.mc.present ? &o.mc : NULL) == -1)
 		return;
 
-	dag->parent->rank = rank;
-	dag->my_rank = rank + 1;
+	/* our parent or rank changed, the neighbors should know soon */
+	changed = dag_select_parent(dag);
+	if (changed)
+		trickle_inconsistent(&dag->trickle);
+	else
+		trickle_consistent(&dag->trickle);
+
+	if (!dag->parent)
+		return;
 
 	dag_process_dio(dag);
 
-	if (dag->parent)
-		send_dao(sock, &dag->parent->addr, dag);
+	/* the dao to the root already goes upwards */
+	if (changed && dag_is_nonstoring(dag)) {
+		if (nl_add_route_default(iface->ifindex, &dag->parent->addr,
+					 NULL, NULL) == -1)
+			flog(LOG_ERR, "failed to queue default route");
+	}
+
+	/* a new parent needs our routes, the current one gets a refresh */
+	if (changed || dag_is_peer(dag->parent, &addr->sin6_addr)) {
+		send_dao(sock, dag_dao_dest(dag), dag);
+	}
+}
+
+
+/* as many /128 targets as fit into a dao of the minimum mtu */
+#define DAO_MAX_TARGETS	(ENC_MTU / \
+			 (offsetof(struct rpl_dao_target, rpl_dao_prefix) + \
+			  sizeof(struct in6_addr)))
+
+struct dao_opts {
+	struct dag *dag;
+	const struct in6_addr *from;
+
+	/* non-storing, the targets wait for the transit which follows */
+	struct in6_addr targets[DAO_MAX_TARGETS];
+	unsigned int count;
+};
+
+static int dao_opt_target(const void *opt, size_t len, void *data)
+{
+	const struct rpl_dao_target *target = opt;
+	char addr_str[INET6_ADDRSTRLEN];
+	struct dao_opts *o = data;
+	struct child *child;
+	int rc;
+
+	if (target->rpl_dao_prefixlen > 128 ||
+	    len < offsetof(struct rpl_dao_target, rpl_dao_prefix) +
+		  bits_to_bytes(target->rpl_dao_prefixlen))
+		return -1;
+
+	/* host routes only */
+	if (target->rpl_dao_prefixlen != 128)
+		return 0;
+
+	addrtostr(&target->rpl_dao_prefix, addr_str, sizeof(addr_str));
+	flog(LOG_INFO, "dao target %s", addr_str);
+
+	if (dag_is_nonstoring(o->dag)) {
+		/* more than our own encoder would put in */
+		if (o->count == DAO_MAX_TARGETS) {
+			flog(LOG_INFO, "dao has more than %zu targets, drop",
+			     DAO_MAX_TARGETS);
+			return -1;
+		}
+
+		o->targets[o->count++] = target->rpl_dao_prefix;
+		return 0;
+	}
+
+	child = dag_lookup_child_or_create(o->dag, &target->rpl_dao_prefix,
+					   o->from);
+	if (!child)
+		return 0;
+
+	/* queued, goes out in one batch at the end of this loop
+	 * iteration. Only the targets of this dao, the other childs
+	 * are unchanged.
+	 */
+	rc = nl_add_route_via(o->dag->iface->ifindex, &child->addr,
+			      &child->from, NULL, NULL);
+	if (rc == -1)
+		flog(LOG_ERR, "failed to queue via route");
+
+	return 0;
+}
+
+/*
+ * The root of a non-storing dag, the targets get the parent of the
+ * transit option which follows them. Only if the parent of a target
+ * changed the source routes of its subtree are computed again.
+ */
+static int dao_opt_transit(const void *opt, size_t len, void *data)
+{
+	const struct rpl_dao_transit *transit = opt;
+	struct dao_opts *o = data;
+	struct in6_addr parent;
+	struct child *child;
+	unsigned int i;
+
+	/* without parent in storing mode, nothing to do with it */
+	if (!dag_is_nonstoring(o->dag))
+		return 0;
+
+	if (len < sizeof(*transit))
+		return -1;
+
+	memcpy(&parent, &transit->rpl_dao_parent, sizeof(parent));
+
+	for (i = 0; i < o->count; i++) {
+		child = child_table_lookup(&o->dag->childs, &o->targets[i]);
+		if (child &&
+		    !memcmp(&child->from, &parent, sizeof(child->from))) {
+			/* refresh */
+			dag_add_srh_route(o->dag, child);
+			continue;
+		}
+
+		child = dag_lookup_child_or_create(o->dag, &o->targets[i],
+						   &parent);
+		if (!child)
+			continue;
+
+		if (dag_topo_update(o->dag, child) == 0)
+			dag_add_srh_subtree(o->dag, child);
+	}
+	o->count = 0;
+
+	return 0;
 }
 
+static const struct opt_type dao_opt_types[OPT_TYPES] = {
+	[RPL_DAO_RPLTARGET] = {
+		.min_len = offsetof(struct rpl_dao_target, rpl_dao_prefix),
+		.cb = dao_opt_target,
+	},
+	[RPL_DAO_TRANSITINFO] = {
+		.min_len = offsetof(struct rpl_dao_transit, rpl_dao_parent),
+		.cb = dao_opt_transit,
+	},
+};
+
 static void process_dao(int sock, struct iface *iface, const void *msg,
 			size_t len, struct sockaddr_in6 *addr)
 {
-	const struct rpl_dao_target *target;
 	const struct nd_rpl_dao *dao = msg;
 	char addr_str[INET6_ADDRSTRLEN];
-	const struct nd_rpl_opt *opt;
-	const unsigned char *p;
-	struct child *child;
+	struct dao_opts o = {};
 	struct dag *dag;
-	struct list *c;
-	int optlen;
-	int rc;
 
 	if (len < sizeof(*dao)) {
 		flog(LOG_INFO, "dao length mismatch, drop");
@@ -135,56 +481,27 @@ static void process_dao(int sock, struct iface *iface, const void *msg,
 		return;
 	}
 
-	p = msg;
-	p += sizeof(*dao);
-	optlen = len;
-	flog(LOG_INFO, "dao optlen %d", optlen);
-	while (optlen > 0) {
-		opt = (const struct nd_rpl_opt *)p;
-
-		if (optlen < sizeof(*opt)) {
-			flog(LOG_INFO, "rpl opt length mismatch, drop");
-			return;
-		}
-
-		flog(LOG_INFO, "dao opt %d", opt->type);
-		switch (opt->type) {
-		case RPL_DAO_RPLTARGET:
-			target = (const struct rpl_dao_target *)p;
-			if (optlen < sizeof(*opt)) {
-				flog(LOG_INFO, "rpl target length mismatch, drop");
-				return;
-			}
-
-			addrtostr(&target->rpl_dao_prefix, addr_str, sizeof(addr_str));
-			flog(LOG_INFO, "dao target %s", addr_str);
-			dag_lookup_child_or_create(dag,
-						   &target->rpl_dao_prefix,
-						   &addr->sin6_addr);
-			break;
-		default:
-			/* IGNORE NOT SUPPORTED */
-			break;
-		}
-
-		/* TODO critical, we trust opt->len here... which is wire data */
-		optlen -= (2 + opt->len);
-		p += (2 + opt->len);
-		flog(LOG_INFO, "dao optlen %d", optlen);
+	/* no downward state below the root */
+	if (dag_is_nonstoring(dag) && !iface->dodag_root) {
+		flog(LOG_INFO, "non-storing dao not for the root, drop");
+		return;
 	}
 
-	DL_FOREACH(dag->childs.head, c) {
-		child = container_of(c, struct child, list);
-
-		rc = nl_add_route_via(dag->iface->ifindex, &child->addr,
-				      &child->from);
-		flog(LOG_INFO, "via route %d %s", rc, strerror(errno));
+	o.dag = dag;
+	o.from = &addr->sin6_addr;
+	if (opt_parse((const unsigned char *)msg + sizeof(*dao), len,
+		      dao_opt_types, &o) == -1) {
+		flog(LOG_INFO, "dao options malformed, drop");
+		return;
 	}
 
 	flog(LOG_INFO, "process dao %s", addr_str);
-	send_dao_ack(sock, &addr->sin6_addr, dag);
+	send_dao_ack(sock, &addr->sin6_addr, dag, dao->rpl_daoseq);
 }
 
+/* nothing we know of yet, only checked */
+static const struct opt_type daoack_opt_types[OPT_TYPES];
+
 static void process_daoack(int sock, struct iface *iface, const void *msg,
 			   size_t len, struct sockaddr_in6 *addr)
 {
@@ -201,6 +518,12 @@ static void process_daoack(int sock, struct iface *iface, const void *msg,
 	addrtostr(&addr->sin6_addr, addr_str, sizeof(addr_str));
 	flog(LOG_INFO, "received daoack %s", addr_str);
 
+	if (opt_parse((const unsigned char *)msg + sizeof(*daoack),
+		      len - sizeof(*daoack), daoack_opt_types, NULL) == -1) {
+		flog(LOG_INFO, "daoack options malformed, drop");
+		return;
+	}
+
 	dag = dag_lookup(iface, daoack->rpl_instanceid,
 			 &daoack->rpl_dagid);
 	if (!dag) {
@@ -209,17 +532,75 @@ static void process_daoack(int sock, struct iface *iface, const void *msg,
 		return;
 	}
 
+	rc = dag_daoack_process(dag, daoack->rpl_daoseq);
+	if (rc == -1) {
+		flog(LOG_INFO, "no dao pending for dsn %u, drop",
+		     daoack->rpl_daoseq);
+		return;
+	}
+
+	/* rejected by the parent */
+	if (daoack->rpl_status >= RPL_DAOACK_STATUS_REJECT) {
+		flog(LOG_WARNING, "dao rejected with status %u",
+		     daoack->rpl_status);
+		return;
+	}
+
 	if (dag->parent) {
-		rc = nl_add_route_default(dag->iface->ifindex, &dag->parent->addr);
-		flog(LOG_INFO, "default route %d %s", rc, strerror(errno));
+		rc = nl_add_route_default(dag->iface->ifindex,
+					  &dag->parent->addr, NULL, NULL);
+		if (rc == -1)
+			flog(LOG_ERR, "failed to queue default route");
 	}
+}
+
+struct dis_opts {
+	const struct rpl_dis_solicitedinfo *si;
+};
+
+static int dis_opt_solicited(const void *opt, size_t len, void *data)
+{
+	struct dis_opts *o = data;
 
+	o->si = opt;
+	return 0;
+}
+
+static const struct opt_type dis_opt_types[OPT_TYPES] = {
+	[RPL_DIS_SOLICITEDINFO] = {
+		.min_len = sizeof(struct rpl_dis_solicitedinfo),
+		.cb = dis_opt_solicited,
+	},
+};
+
+/* RFC 6550 8.3, every predicate which is set must match */
+static bool dis_solicits(const struct rpl_dis_solicitedinfo *si,
+			 const struct dag *dag)
+{
+	if (!si)
+		return true;
+
+	if ((si->rpl_dis_flags & RPL_DIS_SI_V) &&
+	    si->rpl_dis_instanceid != dag->rpl->instance_id)
+		return false;
+
+	if ((si->rpl_dis_flags & RPL_DIS_SI_I) &&
+	    memcmp(si->rpl_dis_dagid, &dag->dodagid, DAGID_LEN))
+		return false;
+
+	if ((si->rpl_dis_flags & RPL_DIS_SI_D) &&
+	    si->rpl_dis_versionnum != dag->version)
+		return false;
+
+	return true;
 }
 
 static void process_dis(int sock, struct iface *iface, const void *msg,
-			size_t len, struct sockaddr_in6 *addr)
+			size_t len, struct sockaddr_in6 *addr, bool multicast)
 {
 	char addr_str[INET6_ADDRSTRLEN];
+	const struct nd_rpl_dis *dis = msg;
+	struct dis_opts o = {};
 	struct list *r, *d;
 	struct rpl *rpl;
 	struct dag *dag;
@@ -227,12 +608,37 @@ static void process_dis(int sock, struct iface *iface, const void *msg,
 	addrtostr(&addr->sin6_addr, addr_str, sizeof(addr_str));
 	flog(LOG_INFO, "received dis %s", addr_str);
 
+	if (len < sizeof(*dis)) {
+		flog(LOG_INFO, "dis length mismatch, drop");
+		return;
+	}
+
+	if (opt_parse((const unsigned char *)msg + sizeof(*dis),
+		      len - sizeof(*dis), dis_opt_types, &o) == -1) {
+		flog(LOG_INFO, "dis options malformed, drop");
+		return;
+	}
+
+	if (!dis_allow(iface->ifindex, &addr->sin6_addr)) {
+		flog(LOG_INFO, "dis of %s over its rate, drop", addr_str);
+		return;
+	}
+
 	DL_FOREACH(iface->rpls.head, r) {
 		rpl = container_of(r, struct rpl, list);
 		DL_FOREACH(rpl->dags.head, d) {
 			dag = container_of(d, struct dag, list);
-
-			send_dio(sock, dag);
+			if (!dis_solicits(o.si, dag))
+				continue;
+
+			/* someone new, start announcing fast again. RFC
+			 * 6550 8.3, a unicast one gets a unicast dio.
+			 */
+			if (multicast)
+				trickle_inconsistent(&dag->trickle);
+			else
+				dis_replies_queue(&dag->dis_replies,
+						  &addr->sin6_addr);
 		}
 	}
 }
@@ -267,7 +673,7 @@ void process(int sock, const struct list_head *ifaces, unsigned char *msg,
 	len -= 4;
 
 	struct icmp6_hdr *icmph = (struct icmp6_hdr *)msg;
-	struct iface *iface = iface_find_by_ifindex(ifaces, pkt_info->ipi6_ifindex);
+	struct iface *iface = iface_find_by_ifindex(pkt_info->ipi6_ifindex);
 	if (!iface) {
 		dlog(LOG_WARNING, 4, "%s received icmpv6 RS/RA packet on an unknown interface with index %d", if_name,
 		     pkt_info->ipi6_ifindex);
@@ -285,7 +691,8 @@ void process(int sock, const struct list_head *ifaces, unsigned char *msg,
 
 	switch (icmph->icmp6_code) {
 	case ND_RPL_DAG_IS:
-		process_dis(sock, iface, &icmph->icmp6_dataun, len, addr);
+		process_dis(sock, iface, &icmph->icmp6_dataun, len, addr,
+			    IN6_IS_ADDR_MULTICAST(&pkt_info->ipi6_addr));
 		break;
 	case ND_RPL_DAG_IO:
 		process_dio(sock, iface, &icmph->icmp6_dataun, len, addr);
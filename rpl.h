@@ -115,6 +115,8 @@ enum RPL_SUBOPT {
         RPL_DIS_SOLICITEDINFO=7,
         RPL_DIO_DESTPREFIX  = 8,
         RPL_DAO_RPLTARGET_DESC=9,
+        /* not assigned, see struct rpl_dio_lowpan_ctx */
+        RPL_DIO_LOWPAN_CTX  = 0x22,
 };
 
 struct rpl_dio_genoption {
@@ -142,6 +144,79 @@ struct rpl_dio_destprefix {
 //    u_int8_t rpl_dio_prefix[16];      /* send 16 bytes,even if fewer are used*/
 } PACKED;
 
+/* The 6LoWPAN Context Option of RFC 6775 carried by DIOs, so all nodes of
+ * a DODAG use the same context id for its prefix. RPL has no such option,
+ * nodes which don't know it ignore it as required by RFC 6550 6.7.1.
+ */
+struct rpl_dio_lowpan_ctx {
+    u_int8_t rpl_dio_type;
+    u_int8_t rpl_dio_len;
+    u_int8_t rpl_dio_ctxlen;           /* in bits */
+    u_int8_t rpl_dio_flags;            /* bit 4=C, 0-3=CID */
+    u_int16_t rpl_dio_resv;
+    u_int16_t rpl_dio_lifetime;        /* in units of 60 seconds */
+    struct in6_addr rpl_dio_prefix;    /* only the ctxlen bytes are sent */
+} PACKED;
+
+#define RPL_DIO_LOWPAN_CTX_C       0x10
+#define RPL_DIO_LOWPAN_CTX_CID_MASK 0x0f
+
+/* section 6.7.6, DODAG Configuration */
+struct rpl_dio_config {
+    u_int8_t rpl_dio_type;
+    u_int8_t rpl_dio_len;
+    u_int8_t rpl_dio_flags;            /* bit 3=A, 2-0=PCS */
+    u_int8_t rpl_dio_int_doublings;
+    u_int8_t rpl_dio_int_min;
+    u_int8_t rpl_dio_redundancy;
+    u_int16_t rpl_dio_max_rank_inc;
+    u_int16_t rpl_dio_min_hop_rank_inc;
+    u_int16_t rpl_dio_ocp;
+    u_int8_t rpl_dio_resv;
+    u_int8_t rpl_dio_def_lifetime;     /* in lifetime units */
+    u_int16_t rpl_dio_lifetime_unit;   /* in seconds */
+} PACKED;
+
+/* RFC 6551, objects of the DAG Metric Container option */
+enum RPL_MC_TYPE {
+        /* reserved, we take it for no metric */
+        RPL_MC_NONE         = 0,
+        RPL_MC_NE           = 2,
+        RPL_MC_HC           = 3,
+        RPL_MC_LATENCY      = 5,
+        RPL_MC_ETX          = 7,
+};
+
+struct rpl_mc_object {
+    u_int8_t rpl_mc_type;
+    u_int8_t rpl_mc_flags;             /* bit 2=P, 1=C, 0=O */
+    u_int8_t rpl_mc_aggr;              /* bit 7=R, 6-4=A, 3-0=Prec */
+    u_int8_t rpl_mc_len;               /* of the body */
+    u_int8_t rpl_mc_data[0];
+} PACKED;
+
+#define RPL_MC_C                   0x02
+#define RPL_MC_R                   0x80
+#define RPL_MC_A_SHIFT             4
+#define RPL_MC_A_ADDITIVE          0
+
+/* the body lengths */
+#define RPL_MC_NE_LEN              2
+#define RPL_MC_HC_LEN              2
+#define RPL_MC_LATENCY_LEN         4
+#define RPL_MC_ETX_LEN             2
+
+/* node energy flags, bit 3=I, 2-1=T, 0=E, the estimation follows */
+#define RPL_MC_NE_T_SHIFT          1
+#define RPL_MC_NE_T_MASK           (3 << RPL_MC_NE_T_SHIFT)
+#define RPL_MC_NE_T(X)             (((X)&RPL_MC_NE_T_MASK) >> RPL_MC_NE_T_SHIFT)
+
+enum RPL_MC_NE_TYPE {
+        RPL_MC_NE_MAINS     = 0,
+        RPL_MC_NE_BATTERY   = 1,
+        RPL_MC_NE_SCAVENGER = 2,
+};
+
 /* section 6.4.1, DODAG Information Object (DIO) */
 struct nd_rpl_dao {
     u_int8_t  rpl_instanceid;
@@ -171,6 +246,19 @@ struct rpl_dao_target {
     struct in6_addr rpl_dao_prefix;        /* variables number of bytes */
 } PACKED;
 
+/* section 6.7.8, Transit Information, parent is non-storing mode only */
+struct rpl_dao_transit {
+    u_int8_t rpl_dao_type;
+    u_int8_t rpl_dao_len;
+    u_int8_t rpl_dao_flags;            /* bit 7=E */
+    u_int8_t rpl_dao_path_control;
+    u_int8_t rpl_dao_path_seq;
+    u_int8_t rpl_dao_path_lifetime;    /* in lifetime units */
+    struct in6_addr rpl_dao_parent;
+} PACKED;
+
+#define RPL_DAO_PATH_LIFETIME_INFINITE 0xff
+
 /* section 6.5.1, Destination Advertisement Object Acknowledgement (DAO-ACK) */
 struct nd_rpl_daoack {
     u_int8_t  rpl_instanceid;
@@ -183,6 +271,8 @@ struct nd_rpl_daoack {
 #define RPL_DAOACK_D_SHIFT   7
 #define RPL_DAOACK_D_MASK    (1 << RPL_DAOACK_D_SHIFT)
 #define RPL_DAOACK_D(X)      (((X)&RPL_DAOACK_D_MASK) >> RPL_DAOACK_D_SHIFT)
+/* status values from 128 on are a rejection */
+#define RPL_DAOACK_STATUS_REJECT 128
 
 
 
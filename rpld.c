@@ -22,6 +22,9 @@
 #include "helpers.h"
 #include "socket.h"
 #include "config.h"
+#include "pool.h"
+#include "wheel.h"
+#include "neigh.h"
 #include "send.h"
 #include "recv.h"
 #include "log.h"
@@ -71,12 +74,12 @@ static void icmpv6_cb(EV_P_ ev_io *w, int revents)
 	}
 }
 
-static void trickle_cb(EV_P_ ev_timer *w, int revents)
+static void trickle_cb(struct trickle *t)
 {
-	struct dag *dag = container_of(w, struct dag, trickle_w);
+	struct dag *dag = container_of(t, struct dag, trickle);
 
 	flog(LOG_INFO, "send dio %p", dag->parent);
-	send_dio(sock, dag);
+	send_dio(sock, dag, &all_rpl_addr);
 }
 
 static void sigint_cb(struct ev_loop *loop, ev_signal *w, int revents)
@@ -84,21 +87,116 @@ static void sigint_cb(struct ev_loop *loop, ev_signal *w, int revents)
 	ev_break(loop, EVBREAK_ALL);
 }
 
-static void send_dis_cb(EV_P_ ev_timer *w, int revents)
+static void sigusr1_cb(struct ev_loop *loop, ev_signal *w, int revents)
+{
+	struct list *i, *r, *d;
+	struct iface *iface;
+	struct rpl *rpl;
+	struct dag *dag;
+
+	pool_stats();
+	neigh_dump();
+
+	/* only the non-storing root knows the topology */
+	DL_FOREACH(ifaces.head, i) {
+		iface = container_of(i, struct iface, list);
+		if (!iface->dodag_root)
+			continue;
+
+		DL_FOREACH(iface->rpls.head, r) {
+			rpl = container_of(r, struct rpl, list);
+			DL_FOREACH(rpl->dags.head, d) {
+				dag = container_of(d, struct dag, list);
+				if (dag_is_nonstoring(dag))
+					dag_topo_dump(dag);
+			}
+		}
+	}
+}
+
+static void send_dis_cb(struct wheel_timer *w)
 {
 	struct iface *iface = container_of(w, struct iface, dis_w);
 
-	ev_timer_stop(loop, w);
-	send_dis(sock, iface);
+	send_dis(sock, iface, &all_rpl_addr);
+}
+
+/* the coalesced answers to the unicast dis of a window */
+static void dis_replies_cb(struct wheel_timer *w)
+{
+	struct dag *dag = container_of(w, struct dag, dis_replies.w);
+	struct dis_replies *replies = &dag->dis_replies;
+	unsigned int i;
+
+	if (replies->multicast) {
+		send_dio(sock, dag, &all_rpl_addr);
+	} else {
+		for (i = 0; i < replies->count; i++)
+			send_dio(sock, dag, &replies->to[i]);
+	}
+
+	dis_replies_reset(replies);
+}
+
+/* a unicast dis must be answered by a dio */
+static void neigh_probe_cb(const struct neigh *neigh, void *data)
+{
+	struct iface *iface;
+
+	iface = iface_find_by_ifindex(neigh->ifindex);
+	if (iface)
+		send_dis(sock, iface, &neigh->addr);
+}
+
+static void dao_cb(struct wheel_timer *w)
+{
+	struct dag *dag = container_of(w, struct dag, dao_w);
+	int dsn;
+
+	if (!dag->parent)
+		return;
+
+	while ((dsn = dag_daoack_retry(dag)) != -1) {
+		flog(LOG_INFO, "retransmit dao dsn %d", dsn);
+		send_dao_part(sock, dag_dao_dest(dag), dag, dsn);
+	}
 }
 
 /* TODO move somewhere else */
-struct ev_loop *foo;
 void dag_init_timer(struct dag *dag)
 {
-	ev_timer_init(&dag->trickle_w, trickle_cb,
-		      dag->trickle_t, dag->trickle_t);
-	ev_timer_start(foo, &dag->trickle_w);
+	trickle_init(&dag->trickle, trickle_cb);
+	wheel_timer_init(&dag->dao_w, dao_cb);
+	dis_replies_init(&dag->dis_replies, dis_replies_cb);
+}
+
+/* seed the children of a previous run, DAOs refresh them */
+static void reconcile_route_cb(uint32_t ifindex, const struct in6_prefix *dst,
+			       const struct in6_addr *via, bool expired,
+			       void *data)
+{
+	struct iface *iface = data;
+	struct list *r, *d;
+	struct rpl *rpl;
+	struct dag *dag;
+
+	if (dst->len != 128)
+		return;
+
+	DL_FOREACH(iface->rpls.head, r) {
+		rpl = container_of(r, struct rpl, list);
+		DL_FOREACH(rpl->dags.head, d) {
+			dag = container_of(d, struct dag, list);
+			if (!in6_prefix_contains(&dag->dest, &dst->prefix))
+				continue;
+
+			if (expired)
+				dag_del_child(dag, &dst->prefix);
+			else
+				dag_lookup_child_or_create(dag, &dst->prefix,
+							   via);
+		}
+	}
 }
 
 static int rpld_setup(struct ev_loop *loop, struct list_head *ifaces)
@@ -107,31 +205,72 @@ static int rpld_setup(struct ev_loop *loop, struct list_head *ifaces)
 	struct iface *iface;
 	struct rpl *rpl;
 	struct dag *dag;
+	int rc;
 
 	DL_FOREACH(ifaces->head, i) {
 		iface = container_of(i, struct iface, list);
 
-		ev_timer_init(&iface->dis_w, send_dis_cb, 1, 1);
+		rc = nl_set_route_table(iface->ifindex, iface->rt_table,
+					iface->rt_proto);
+		if (rc == -1)
+			return -1;
+
+		/* adopt whatever a previous run left behind */
+		rc = nl_reconcile_routes(iface->ifindex,
+					 DEFAULT_RECONCILE_GRACE,
+					 reconcile_route_cb, iface);
+		if (rc == -1)
+			return -1;
+
+		wheel_timer_init(&iface->dis_w, send_dis_cb);
 		/* schedule a dis at statup */
-		ev_timer_start(loop, &iface->dis_w);
+		wheel_timer_start(&iface->dis_w, 1, 0);
 
 		DL_FOREACH(iface->rpls.head, r) {
 			rpl = container_of(r, struct rpl, list);
 			DL_FOREACH(rpl->dags.head, d) {
 				dag = container_of(d, struct dag, list);
 
-				ev_timer_init(&dag->trickle_w, trickle_cb,
-					      dag->trickle_t, dag->trickle_t);
-				ev_timer_start(loop, &dag->trickle_w);
-
 				/* TODO wrong here */
-				if (iface->dodag_root)
-					nl_add_addr(iface->ifindex, &dag->dodagid);
+				if (iface->dodag_root) {
+					nl_add_addr(iface->ifindex, &dag->dodagid,
+						    NULL, NULL);
+
+					/* announced by our dios */
+					rc = lowpan_ctx_alloc(iface, &dag->dest);
+					if (rc != -1) {
+						dag->has_ctx = true;
+						dag->ctx_cid = rc;
+						dag_dio_invalidate(dag);
+					}
+				}
 			}
 		}
 	}
 
-	return 0;
+	return netlink_sync();
+}
+
+/* remove everything we installed before we go, a warm restart keeps it
+ * for the next run.
+ */
+static void rpld_teardown(struct list_head *ifaces)
+{
+	struct iface *iface;
+	struct list *i;
+
+	DL_FOREACH(ifaces->head, i) {
+		iface = container_of(i, struct iface, list);
+
+		if (iface->warm_restart)
+			continue;
+
+		lowpan_ctx_flush(iface);
+		nl_flush_routes(iface->ifindex, NULL, NULL);
+		nl_unset_route_table(iface->ifindex);
+	}
+
+	netlink_sync();
 }
 
 int main(int argc, char *argv[])
@@ -144,12 +283,10 @@ int main(int argc, char *argv[])
 	int log_method = L_UNSPEC;
 	ev_io sock_watcher;
 	ev_signal exitsig;
+	ev_signal statsig;
 	int opt;
 	int rc;
 
-	/* TODO this is a hack need to rework some parts */
-	foo = loop;
-
 	/* TODO add longopt as the help says it */
 	while ((opt = getopt(argc, argv, "C:m:f:l:d:h")) != -1) {
 		switch (opt) {
@@ -197,6 +334,8 @@ int main(int argc, char *argv[])
 	init_random_gen();
 	ev_signal_init(&exitsig, sigint_cb, SIGINT);
 	ev_signal_start(loop, &exitsig);
+	ev_signal_init(&statsig, sigusr1_cb, SIGUSR1);
+	ev_signal_start(loop, &statsig);
 
 	if (log_method == L_UNSPEC)
 		log_method = L_STDERR;
@@ -207,12 +346,27 @@ int main(int argc, char *argv[])
 
 	flog(LOG_INFO, "version %s started", VERSION);
 
-	rc = netlink_open();
+	/* keyed by the kernel, wire addresses can't be made to collide */
+	if (child_hash_init() == -1 || dag_hash_init() == -1) {
+		flog(LOG_ERR, "no random hash keys: %s", strerror(errno));
+		exit(1);
+	}
+
+	wheel_open(loop, DEFAULT_TIMER_TICK);
+
+	rc = netlink_open(loop);
 	if (rc == -1) {
 		perror("mnl_socket_open");
 		exit(1);
 	}
 
+	rc = nl_links_open(iface_link_cb, &ifaces);
+	if (rc == -1) {
+		netlink_close();
+		flog(LOG_ERR, "Failed to dump links");
+		exit(1);
+	}
+
 	rc = config_load(conf_path, &ifaces);
 	if (rc < 0) {
 		netlink_close();
@@ -241,11 +395,16 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	neigh_open(neigh_probe_cb, NULL);
+
 	ev_io_init(&sock_watcher, icmpv6_cb, sock, EV_READ);
 	ev_io_start(loop, &sock_watcher);
 
 	ev_run(loop, 0);
 
+	neigh_close();
+	wheel_close();
+	rpld_teardown(&ifaces);
 	netlink_close();
 	close_icmpv6_socket(sock, &ifaces);
 	config_free(&ifaces);
@@ -20,27 +20,26 @@
 #include <sys/socket.h>
 
 #include "helpers.h"
-#include "buffer.h"
-#include "config.h"
+#include "enc.h"
 #include "config.h"
 #include "send.h"
 #include "log.h"
 #include "rpl.h"
 
 static int really_send(int sock, const struct iface *iface,
+		       const struct in6_addr *src,
 		       const struct in6_addr *dest,
-		       struct safe_buffer *sb)
+		       const void *buf, size_t len)
 {
 	struct sockaddr_in6 addr;
-	int rc;
 	memset((void *)&addr, 0, sizeof(addr));
 	addr.sin6_family = AF_INET6;
 	addr.sin6_port = htons(IPPROTO_ICMPV6);
 	memcpy(&addr.sin6_addr, dest, sizeof(struct in6_addr));
 
 	struct iovec iov;
-	iov.iov_len = sb->used;
-	iov.iov_base = (caddr_t)sb->buffer;
+	iov.iov_len = len;
+	iov.iov_base = (caddr_t)buf;
 
 	char __attribute__((aligned(8))) chdr[CMSG_SPACE(sizeof(struct in6_pktinfo))];
 	memset(chdr, 0, sizeof(chdr));
@@ -52,7 +51,7 @@ static int really_send(int sock, const struct iface *iface,
 
 	struct in6_pktinfo *pkt_info = (struct in6_pktinfo *)CMSG_DATA(cmsg);
 	pkt_info->ipi6_ifindex = iface->ifindex;
-	memcpy(&pkt_info->ipi6_addr, iface->ifaddr_src, sizeof(struct in6_addr));
+	memcpy(&pkt_info->ipi6_addr, src, sizeof(struct in6_addr));
 
 #ifdef HAVE_SIN6_SCOPE_ID
 	if (IN6_IS_ADDR_LINKLOCAL(&addr.sin6_addr) || IN6_IS_ADDR_MC_LINKLOCAL(&addr.sin6_addr))
@@ -68,63 +67,94 @@ static int really_send(int sock, const struct iface *iface,
 	mhdr.msg_control = (void *)cmsg;
 	mhdr.msg_controllen = sizeof(chdr);
 
-	rc = sendmsg(sock, &mhdr, 0);
-	safe_buffer_free(sb);
+	return sendmsg(sock, &mhdr, 0);
+}
 
-	return rc;
+/* non-storing daos and acks cross several hops, link-local won't do */
+static const struct in6_addr *dao_src(const struct dag *dag)
+{
+	if (dag_is_nonstoring(dag))
+		return &dag->self;
+
+	return dag->iface->ifaddr_src;
 }
-void send_dio(int sock, struct dag *dag)
+
+/* the prebuilt one of the dag */
+void send_dio(int sock, struct dag *dag, const struct in6_addr *to)
 {
-	struct safe_buffer *sb;
+	const void *dio;
+	size_t len;
 	int rc;
 
-	sb = safe_buffer_new();
-	if (!sb)
+	dio = dag_get_dio(dag, &len);
+	if (!dio)
 		return;
 
-	dag_build_dio(dag, sb);
-	rc = really_send(sock, dag->iface, &all_rpl_addr, sb);
+	rc = really_send(sock, dag->iface, dag->iface->ifaddr_src, to, dio,
+			 len);
 	flog(LOG_INFO, "foo! %s %d %s", dag->iface->ifname, rc ,strerror(errno));
 }
 
+/* targets which don't fit into one go out in more daos, each part has
+ * its own dsn and is acked on its own.
+ */
 void send_dao(int sock, const struct in6_addr *to, struct dag *dag)
 {
-	struct safe_buffer *sb;
+	uint32_t next = 0;
+	struct enc e;
+	int rc;
+
+	do {
+		dag_daoack_insert(dag, !next);
+
+		enc_init(&e, dag->iface->tx, sizeof(dag->iface->tx));
+		if (dag_build_dao(dag, dag->dsn, &e, &next) == -1)
+			return;
+
+		rc = really_send(sock, dag->iface, dao_src(dag), to, e.buf,
+				 e.len);
+		flog(LOG_INFO, "send_dao! %d", rc);
+	} while (next && rc != -1);
+}
+
+/* again the part of dsn only */
+void send_dao_part(int sock, const struct in6_addr *to, struct dag *dag,
+		   uint8_t dsn)
+{
+	struct enc e;
 	int rc;
 
-	sb = safe_buffer_new();
-	if (!sb)
+	enc_init(&e, dag->iface->tx, sizeof(dag->iface->tx));
+	if (dag_build_dao_part(dag, dsn, &e) == -1)
 		return;
 
-	dag_build_dao(dag, sb);
-	rc = really_send(sock, dag->iface, to, sb);
+	rc = really_send(sock, dag->iface, dao_src(dag), to, e.buf, e.len);
 	flog(LOG_INFO, "send_dao! %d", rc);
 }
 
-void send_dao_ack(int sock, const struct in6_addr *to, struct dag *dag)
+void send_dao_ack(int sock, const struct in6_addr *to, struct dag *dag,
+		  uint8_t dsn)
 {
-	struct safe_buffer *sb;
+	struct enc e;
 	int rc;
 
-	sb = safe_buffer_new();
-	if (!sb)
+	enc_init(&e, dag->iface->tx, sizeof(dag->iface->tx));
+	if (dag_build_dao_ack(dag, dsn, &e) == -1)
 		return;
 
-	dag_build_dao_ack(dag, sb);
-	rc = really_send(sock, dag->iface, to, sb);
+	rc = really_send(sock, dag->iface, dao_src(dag), to, e.buf, e.len);
 	flog(LOG_INFO, "send_dao_ack! %d", rc);
 }
 
-void send_dis(int sock, struct iface *iface)
+void send_dis(int sock, struct iface *iface, const struct in6_addr *to)
 {
-	struct safe_buffer *sb;
+	struct enc e;
 	int rc;
 
-	sb = safe_buffer_new();
-	if (!sb)
+	enc_init(&e, iface->tx, sizeof(iface->tx));
+	if (dag_build_dis(&e) == -1)
 		return;
 
-	dag_build_dis(sb);
-	rc = really_send(sock, iface, &all_rpl_addr, sb);
+	rc = really_send(sock, iface, iface->ifaddr_src, to, e.buf, e.len);
 	flog(LOG_INFO, "send_dis! %d", rc);
 }
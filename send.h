@@ -15,9 +15,12 @@
 
 #include "dag.h"
 
-void send_dio(int sock, struct dag *dag);
+void send_dio(int sock, struct dag *dag, const struct in6_addr *to);
 void send_dao(int sock, const struct in6_addr *to, struct dag *dag);
-void send_dao_ack(int sock, const struct in6_addr *to, struct dag *dag);
-void send_dis(int sock, struct iface *iface);
+void send_dao_part(int sock, const struct in6_addr *to, struct dag *dag,
+		   uint8_t dsn);
+void send_dao_ack(int sock, const struct in6_addr *to, struct dag *dag,
+		  uint8_t dsn);
+void send_dis(int sock, struct iface *iface, const struct in6_addr *to);
 
 #endif /* __RPLD_SEND_H__ */
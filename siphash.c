@@ -0,0 +1,127 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+/*
+ * SipHash-2-4 by Jean-Philippe Aumasson and Daniel J. Bernstein. Keyed,
+ * so addresses from the wire can't be chosen to collide in our tables.
+ */
+
+#include <sys/random.h>
+#include <errno.h>
+#include <string.h>
+
+#include "siphash.h"
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND					\
+	do {						\
+		v0 += v1; v1 = ROTL(v1, 13);		\
+		v1 ^= v0; v0 = ROTL(v0, 32);		\
+		v2 += v3; v3 = ROTL(v3, 16);		\
+		v3 ^= v2;				\
+		v0 += v3; v3 = ROTL(v3, 21);		\
+		v3 ^= v0;				\
+		v2 += v1; v1 = ROTL(v1, 17);		\
+		v1 ^= v2; v2 = ROTL(v2, 32);		\
+	} while (0)
+
+static uint64_t u8to64_le(const uint8_t *p)
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+	       (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	       (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	       (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+/* blocks until the kernel has entropy, -1 with errno if it has none to
+ * give. A guessable key is no key, so there is no fallback.
+ */
+int siphash_key_init(struct siphash_key *key)
+{
+	unsigned char *p = (unsigned char *)key->k;
+	size_t len = 0;
+	ssize_t rc;
+
+	while (len < sizeof(key->k)) {
+		rc = getrandom(p + len, sizeof(key->k) - len, 0);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		len += rc;
+	}
+
+	return 0;
+}
+
+uint64_t siphash(const void *data, size_t len, const struct siphash_key *key)
+{
+	uint64_t v0 = 0x736f6d6570736575ULL ^ key->k[0];
+	uint64_t v1 = 0x646f72616e646f6dULL ^ key->k[1];
+	uint64_t v2 = 0x6c7967656e657261ULL ^ key->k[0];
+	uint64_t v3 = 0x7465646279746573ULL ^ key->k[1];
+	const uint8_t *in = data;
+	const uint8_t *end = in + len - (len % 8);
+	uint64_t b = (uint64_t)len << 56;
+	uint64_t m;
+
+	for (; in != end; in += 8) {
+		m = u8to64_le(in);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	switch (len & 7) {
+	case 7:
+		b |= (uint64_t)in[6] << 48;
+		/* fallthrough */
+	case 6:
+		b |= (uint64_t)in[5] << 40;
+		/* fallthrough */
+	case 5:
+		b |= (uint64_t)in[4] << 32;
+		/* fallthrough */
+	case 4:
+		b |= (uint64_t)in[3] << 24;
+		/* fallthrough */
+	case 3:
+		b |= (uint64_t)in[2] << 16;
+		/* fallthrough */
+	case 2:
+		b |= (uint64_t)in[1] << 8;
+		/* fallthrough */
+	case 1:
+		b |= (uint64_t)in[0];
+		break;
+	case 0:
+		break;
+	}
+
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
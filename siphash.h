@@ -0,0 +1,26 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_SIPHASH_H__
+#define __RPLD_SIPHASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct siphash_key {
+	uint64_t k[2];
+};
+
+int siphash_key_init(struct siphash_key *key);
+uint64_t siphash(const void *data, size_t len, const struct siphash_key *key);
+
+#endif /* __RPLD_SIPHASH_H__ */
@@ -0,0 +1,186 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <string.h>
+
+#include "helpers.h"
+#include "topo.h"
+
+void topo_init(struct topo *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->root.subtree = 1;
+}
+
+bool topo_is_rooted(const struct topo *t, const struct topo_node *node)
+{
+	while (node->parent)
+		node = node->parent;
+
+	return node == &t->root;
+}
+
+uint16_t topo_max_depth(const struct topo *t)
+{
+	uint16_t depth;
+
+	for (depth = TOPO_MAX_DEPTH; depth > 0; depth--) {
+		if (t->depths[depth])
+			break;
+	}
+
+	return depth;
+}
+
+/* preorder walk of the subtree of top without recursion */
+struct topo_node *topo_next(const struct topo_node *node,
+			    const struct topo_node *top)
+{
+	if (node->childs.head)
+		return container_of(node->childs.head, struct topo_node, list);
+
+	while (node != top) {
+		if (node->list.next)
+			return container_of(node->list.next, struct topo_node,
+					    list);
+
+		node = node->parent;
+	}
+
+	return NULL;
+}
+
+static void topo_check_hot(struct topo *t, struct topo_node *node)
+{
+	bool hot;
+
+	if (node == &t->root)
+		return;
+
+	hot = node->fanout >= TOPO_HOT_FANOUT ||
+	      node->subtree > TOPO_HOT_SUBTREE;
+	if (hot == node->hot)
+		return;
+
+	node->hot = hot;
+	if (hot)
+		t->hot++;
+	else
+		t->hot--;
+}
+
+static void topo_count_depths(struct topo *t, struct topo_node *top,
+			      int delta)
+{
+	struct topo_node *node;
+	uint16_t depth;
+
+	topo_foreach_subtree(top, node) {
+		if (delta > 0)
+			node->depth = node->parent->depth + 1;
+
+		depth = node->depth;
+		if (depth > TOPO_MAX_DEPTH)
+			depth = TOPO_MAX_DEPTH;
+
+		t->depths[depth] += delta;
+	}
+}
+
+static void topo_unlink(struct topo *t, struct topo_node *node)
+{
+	struct topo_node *a, *parent = node->parent;
+
+	if (!parent) {
+		DL_DELETE(t->orphans.head, &node->list);
+		return;
+	}
+
+	if (topo_is_rooted(t, node))
+		topo_count_depths(t, node, -1);
+
+	for (a = parent; a; a = a->parent) {
+		a->subtree -= node->subtree;
+		topo_check_hot(t, a);
+	}
+
+	DL_DELETE(parent->childs.head, &node->list);
+	parent->fanout--;
+	topo_check_hot(t, parent);
+	node->parent = NULL;
+}
+
+/*
+ * Moves node with its subtree below parent, NULL makes it an orphan. -1
+ * if parent is inside the subtree, nothing changed then.
+ */
+int topo_attach(struct topo *t, struct topo_node *node,
+		struct topo_node *parent)
+{
+	struct topo_node *a;
+
+	for (a = parent; a; a = a->parent) {
+		if (a == node)
+			return -1;
+	}
+
+	if (node->subtree) {
+		if (node->parent == parent && parent)
+			return 0;
+
+		topo_unlink(t, node);
+	} else {
+		node->subtree = 1;
+	}
+
+	node->parent = parent;
+	if (!parent) {
+		DL_APPEND(t->orphans.head, &node->list);
+		return 0;
+	}
+
+	DL_APPEND(parent->childs.head, &node->list);
+	parent->fanout++;
+	for (a = parent; a; a = a->parent) {
+		a->subtree += node->subtree;
+		topo_check_hot(t, a);
+	}
+
+	if (topo_is_rooted(t, node))
+		topo_count_depths(t, node, 1);
+
+	return 0;
+}
+
+/* node goes away, its childs become orphans with their subtrees */
+void topo_del(struct topo *t, struct topo_node *node)
+{
+	struct topo_node *c;
+	struct list *p, *tmp;
+
+	if (!node->subtree)
+		return;
+
+	topo_unlink(t, node);
+	if (node->hot)
+		t->hot--;
+
+	DL_FOREACH_SAFE(node->childs.head, p, tmp) {
+		c = container_of(p, struct topo_node, list);
+
+		DL_DELETE(node->childs.head, p);
+		c->parent = NULL;
+		DL_APPEND(t->orphans.head, p);
+	}
+
+	memset(node, 0, sizeof(*node));
+}
@@ -0,0 +1,74 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_TOPO_H__
+#define __RPLD_TOPO_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+
+/* a relay with as many childs or nodes below is a hot-spot */
+#define TOPO_HOT_FANOUT		8
+#define TOPO_HOT_SUBTREE	32
+
+/* deeper nodes are counted in the last bucket */
+#define TOPO_MAX_DEPTH		32
+
+struct topo_node {
+	struct topo_node *parent;
+	struct list_head childs;
+	/* in the childs of parent or orphans */
+	struct list list;
+
+	/* nodes below and itself, zero if not in the graph */
+	uint32_t subtree;
+	/* hops to the root, only valid if attached to it */
+	uint16_t depth;
+	uint16_t fanout;
+	bool hot;
+};
+
+/*
+ * DODAG as seen by the transit options at the root. Every change only
+ * touches the ancestors of the moved node and the moved subtree itself.
+ */
+struct topo {
+	struct topo_node root;
+	/* parent is unknown yet, each one with its subtree */
+	struct list_head orphans;
+
+	uint32_t hot;
+	/* nodes attached to the root per depth */
+	uint32_t depths[TOPO_MAX_DEPTH + 1];
+};
+
+void topo_init(struct topo *t);
+int topo_attach(struct topo *t, struct topo_node *node,
+		struct topo_node *parent);
+void topo_del(struct topo *t, struct topo_node *node);
+struct topo_node *topo_next(const struct topo_node *node,
+			    const struct topo_node *top);
+bool topo_is_rooted(const struct topo *t, const struct topo_node *node);
+uint16_t topo_max_depth(const struct topo *t);
+
+#define topo_foreach_subtree(top, n) \
+	for ((n) = (top); (n); (n) = topo_next((n), (top)))
+
+/* nodes attached to the root, without the root */
+static inline uint32_t topo_nodes(const struct topo *t)
+{
+	return t->root.subtree - 1;
+}
+
+#endif /* __RPLD_TOPO_H__ */
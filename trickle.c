@@ -0,0 +1,98 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <stdlib.h>
+
+#include "helpers.h"
+#include "trickle.h"
+
+/* in seconds, far beyond any sane Imax */
+#define TRICKLE_I_LIMIT		(1U << 31)
+
+static ev_tstamp trickle_imax(const struct trickle *t)
+{
+	ev_tstamp imax = t->imin;
+	uint8_t i;
+
+	for (i = 0; i < t->doublings && imax < TRICKLE_I_LIMIT; i++)
+		imax *= 2;
+
+	return imax;
+}
+
+static void trickle_interval(struct trickle *t)
+{
+	t->c = 0;
+	t->fired = false;
+	/* uniform in [I/2, I) */
+	t->t = t->i / 2 + t->i / 2 * (random() / ((double)RAND_MAX + 1));
+	wheel_timer_start(&t->w, t->t, 0);
+}
+
+static void trickle_timer_cb(struct wheel_timer *w)
+{
+	struct trickle *t = container_of(w, struct trickle, w);
+	ev_tstamp imax;
+
+	if (!t->fired) {
+		t->fired = true;
+		wheel_timer_start(&t->w, t->i - t->t, 0);
+
+		if (!t->k || t->c < t->k) {
+			t->sent++;
+			t->cb(t);
+		} else {
+			t->suppressed++;
+		}
+
+		return;
+	}
+
+	imax = trickle_imax(t);
+	t->i *= 2;
+	if (t->i > imax)
+		t->i = imax;
+
+	trickle_interval(t);
+}
+
+void trickle_init(struct trickle *t, trickle_cb_t cb)
+{
+	t->cb = cb;
+	wheel_timer_init(&t->w, trickle_timer_cb);
+}
+
+/* starts over with Imin, parameters may have changed */
+void trickle_start(struct trickle *t)
+{
+	t->i = t->imin;
+	trickle_interval(t);
+}
+
+void trickle_stop(struct trickle *t)
+{
+	wheel_timer_stop(&t->w);
+}
+
+void trickle_consistent(struct trickle *t)
+{
+	if (t->c < UINT8_MAX)
+		t->c++;
+}
+
+void trickle_inconsistent(struct trickle *t)
+{
+	if (!wheel_timer_pending(&t->w) || t->i == t->imin)
+		return;
+
+	trickle_start(t);
+}
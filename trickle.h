@@ -0,0 +1,57 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_TRICKLE_H__
+#define __RPLD_TRICKLE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+#include "wheel.h"
+
+struct trickle;
+
+typedef void (*trickle_cb_t)(struct trickle *t);
+
+/*
+ * RFC 6206, transmits once per interval at a random time in its second
+ * half unless k consistent ones were heard before. The interval doubles
+ * up to Imax and goes back to Imin on an inconsistency.
+ */
+struct trickle {
+	ev_tstamp imin;
+	uint8_t doublings;
+	/* redundancy constant, zero never suppresses */
+	uint8_t k;
+
+	/* the interval I, t within it and the counter c */
+	ev_tstamp i;
+	ev_tstamp t;
+	uint8_t c;
+	/* t is over, waiting for the end of the interval */
+	bool fired;
+
+	uint32_t sent;
+	uint32_t suppressed;
+
+	trickle_cb_t cb;
+	struct wheel_timer w;
+};
+
+void trickle_init(struct trickle *t, trickle_cb_t cb);
+void trickle_start(struct trickle *t);
+void trickle_stop(struct trickle *t);
+void trickle_consistent(struct trickle *t);
+void trickle_inconsistent(struct trickle *t);
+
+#endif /* __RPLD_TRICKLE_H__ */
@@ -0,0 +1,310 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#include <string.h>
+
+#include "helpers.h"
+#include "wheel.h"
+
+/*
+ * Every level has 64 slots, a level covers 64 times the range of the
+ * level below. A timer is on the level of the highest digit in which its
+ * expiry differs from now, in the slot of that digit. When now reaches
+ * the start of the slot it gets cascaded down a level. Insert and cancel
+ * are O(1), the next wakeup is found by a bitmap of used slots per level.
+ */
+#define WHEEL_BITS	6
+#define WHEEL_SLOTS	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS	6
+
+struct wheel {
+	struct ev_loop *loop;
+	ev_timer w;
+
+	ev_tstamp tick;
+	/* time of tick zero */
+	ev_tstamp base;
+	/* ticks we processed */
+	uint64_t now;
+	/* tick the ev_timer is armed for, 0 if not armed */
+	uint64_t armed;
+
+	uint64_t used[WHEEL_LEVELS];
+	struct list_head slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	unsigned int count;
+};
+
+static struct wheel wheel;
+
+static unsigned int wheel_digit(uint64_t ticks, unsigned int level)
+{
+	return (ticks >> (level * WHEEL_BITS)) & WHEEL_MASK;
+}
+
+static void wheel_insert(struct wheel_timer *t)
+{
+	unsigned int level, slot;
+	uint64_t diff;
+
+	/* expires is behind now, highest differing digit picks the level */
+	diff = t->expires ^ wheel.now;
+	level = (63 - __builtin_clzll(diff)) / WHEEL_BITS;
+	/* beyond the range, cascading early is harmless */
+	if (level >= WHEEL_LEVELS)
+		level = WHEEL_LEVELS - 1;
+
+	slot = wheel_digit(t->expires, level);
+	t->slot = &wheel.slots[level][slot];
+	DL_APPEND(t->slot->head, &t->list);
+	wheel.used[level] |= 1ULL << slot;
+}
+
+static void wheel_remove(struct wheel_timer *t)
+{
+	struct list_head *slot = t->slot;
+	unsigned int i;
+
+	DL_DELETE(slot->head, &t->list);
+	t->slot = NULL;
+
+	/* the detached list of wheel_run() has no bit */
+	if (t->expired) {
+		t->expired = false;
+		return;
+	}
+
+	if (slot->head)
+		return;
+
+	i = slot - &wheel.slots[0][0];
+	wheel.used[i / WHEEL_SLOTS] &= ~(1ULL << (i % WHEEL_SLOTS));
+}
+
+/* first tick after now at which a used slot is due, 0 if there is none */
+static uint64_t wheel_next(void)
+{
+	uint64_t next = 0, t, used;
+	unsigned int level, shift, d, slot;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		used = wheel.used[level];
+		if (!used)
+			continue;
+
+		shift = level * WHEEL_BITS;
+		d = wheel_digit(wheel.now, level);
+
+		/* first used slot after the current digit, else wrap */
+		if (d < WHEEL_MASK && (used >> (d + 1)))
+			slot = d + 1 + __builtin_ctzll(used >> (d + 1));
+		else
+			slot = __builtin_ctzll(used);
+
+		t = ((wheel.now >> shift) & ~(uint64_t)WHEEL_MASK) | slot;
+		t <<= shift;
+		if (t <= wheel.now)
+			t += (uint64_t)WHEEL_SLOTS << shift;
+
+		if (!next || t < next)
+			next = t;
+	}
+
+	return next;
+}
+
+/* move now to tick, cascade and run what is due there */
+static void wheel_run(uint64_t tick)
+{
+	struct list_head expired = {}, cascade;
+	struct wheel_timer *t;
+	unsigned int level;
+	struct list *e;
+
+	wheel.now = tick;
+
+	for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+		if (tick & ((1ULL << (level * WHEEL_BITS)) - 1))
+			continue;
+
+		cascade = wheel.slots[level][wheel_digit(tick, level)];
+		if (!cascade.head)
+			continue;
+
+		wheel.slots[level][wheel_digit(tick, level)].head = NULL;
+		wheel.used[level] &= ~(1ULL << wheel_digit(tick, level));
+
+		while ((e = cascade.head)) {
+			t = container_of(e, struct wheel_timer, list);
+			DL_DELETE(cascade.head, e);
+
+			if (t->expires == tick) {
+				t->slot = &expired;
+				t->expired = true;
+				DL_APPEND(expired.head, e);
+			} else {
+				wheel_insert(t);
+			}
+		}
+	}
+
+	/* everything on the level 0 slot expires exactly now */
+	cascade = wheel.slots[0][wheel_digit(tick, 0)];
+	wheel.slots[0][wheel_digit(tick, 0)].head = NULL;
+	wheel.used[0] &= ~(1ULL << wheel_digit(tick, 0));
+	while ((e = cascade.head)) {
+		t = container_of(e, struct wheel_timer, list);
+		DL_DELETE(cascade.head, e);
+		t->slot = &expired;
+		t->expired = true;
+		DL_APPEND(expired.head, e);
+	}
+
+	/* callbacks may stop any timer of the batch, so pop one by one */
+	while ((e = expired.head)) {
+		t = container_of(e, struct wheel_timer, list);
+		wheel_remove(t);
+		wheel.count--;
+
+		if (t->repeat) {
+			t->expires += t->repeat;
+			if (t->expires <= wheel.now)
+				t->expires = wheel.now + 1;
+
+			wheel_insert(t);
+			wheel.count++;
+		}
+
+		t->cb(t);
+	}
+}
+
+/* rounded up, never run a timer early */
+static uint64_t wheel_ticks(ev_tstamp time)
+{
+	uint64_t ticks;
+
+	if (time <= 0)
+		return 0;
+
+	ticks = time / wheel.tick;
+	if (ticks * wheel.tick < time)
+		ticks++;
+
+	return ticks;
+}
+
+static void wheel_arm(void)
+{
+	uint64_t next;
+
+	next = wheel_next();
+	if (next == wheel.armed)
+		return;
+
+	ev_timer_stop(wheel.loop, &wheel.w);
+	wheel.armed = next;
+	if (!next)
+		return;
+
+	ev_timer_set(&wheel.w, wheel.base + next * wheel.tick -
+		     ev_now(wheel.loop), 0);
+	ev_timer_start(wheel.loop, &wheel.w);
+}
+
+static void wheel_cb(EV_P_ ev_timer *w, int revents)
+{
+	uint64_t now, next;
+
+	/* the tick we were armed for is due, whatever rounding says */
+	now = (ev_now(loop) - wheel.base) / wheel.tick;
+	if (now < wheel.armed)
+		now = wheel.armed;
+	wheel.armed = 0;
+
+	/* empty slots in between need no visit */
+	while ((next = wheel_next()) && next <= now)
+		wheel_run(next);
+
+	if (now > wheel.now)
+		wheel.now = now;
+
+	wheel_arm();
+}
+
+void wheel_timer_init(struct wheel_timer *t, wheel_cb_t cb)
+{
+	memset(t, 0, sizeof(*t));
+	t->cb = cb;
+}
+
+void wheel_timer_start(struct wheel_timer *t, ev_tstamp after,
+		       ev_tstamp repeat)
+{
+	if (wheel_timer_pending(t))
+		wheel_timer_stop(t);
+
+	t->expires = wheel_ticks(ev_now(wheel.loop) - wheel.base + after);
+	if (t->expires <= wheel.now)
+		t->expires = wheel.now + 1;
+
+	t->repeat = wheel_ticks(repeat);
+	if (repeat > 0 && !t->repeat)
+		t->repeat = 1;
+
+	wheel_insert(t);
+	wheel.count++;
+
+	if (!wheel.armed || t->expires < wheel.armed)
+		wheel_arm();
+}
+
+void wheel_timer_stop(struct wheel_timer *t)
+{
+	if (!wheel_timer_pending(t))
+		return;
+
+	/* a spurious wakeup is cheaper than finding the next one */
+	wheel_remove(t);
+	wheel.count--;
+}
+
+ev_tstamp wheel_now(void)
+{
+	return ev_now(wheel.loop);
+}
+
+/* only while nothing is pending, ticks would change their meaning */
+int wheel_set_tick(ev_tstamp tick)
+{
+	if (wheel.count || tick <= 0)
+		return -1;
+
+	wheel.tick = tick;
+	wheel.base = ev_now(wheel.loop);
+	wheel.now = 0;
+	return 0;
+}
+
+void wheel_open(struct ev_loop *loop, ev_tstamp tick)
+{
+	wheel.loop = loop;
+	wheel.tick = tick;
+	wheel.base = ev_now(loop);
+	ev_init(&wheel.w, wheel_cb);
+}
+
+void wheel_close(void)
+{
+	ev_timer_stop(wheel.loop, &wheel.w);
+	wheel.armed = 0;
+}
@@ -0,0 +1,60 @@
+/*
+ *   Authors:
+ *    Alexander Aring		<alex.aring@gmail.com>
+ *
+ *   This software is Copyright 2019 by the above mentioned author(s),
+ *   All Rights Reserved.
+ *
+ *   The license which is distributed with this software in the file COPYRIGHT
+ *   applies to this software. If your distribution is missing this file, you
+ *   may request it from <alex.aring@gmail.com>.
+ */
+
+#ifndef __RPLD_WHEEL_H__
+#define __RPLD_WHEEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+#include "list.h"
+
+struct wheel_timer;
+
+typedef void (*wheel_cb_t)(struct wheel_timer *t);
+
+/*
+ * Protocol timer, all of them share one hierarchical timing wheel driven
+ * by a single ev_timer. Expiries are rounded up to the wheel tick, the
+ * ones which land in the same tick run in the same wakeup.
+ */
+struct wheel_timer {
+	wheel_cb_t cb;
+
+	/* in ticks */
+	uint64_t expires;
+	uint64_t repeat;
+
+	/* slot list we are on, NULL if not pending */
+	struct list_head *slot;
+	/* slot is the detached list of expired timers of a run */
+	bool expired;
+	struct list list;
+};
+
+void wheel_timer_init(struct wheel_timer *t, wheel_cb_t cb);
+void wheel_timer_start(struct wheel_timer *t, ev_tstamp after,
+		       ev_tstamp repeat);
+void wheel_timer_stop(struct wheel_timer *t);
+
+static inline bool wheel_timer_pending(const struct wheel_timer *t)
+{
+	return t->slot;
+}
+
+ev_tstamp wheel_now(void);
+int wheel_set_tick(ev_tstamp tick);
+void wheel_open(struct ev_loop *loop, ev_tstamp tick);
+void wheel_close(void);
+
+#endif /* __RPLD_WHEEL_H__ */